@@ -5,6 +5,20 @@
 //   publish, and distribute this file as you see fit.
 //
 // VERSION 
+//   0.4.3  (2026-10-18)  Coalesced highlight ranges
+//   0.4.2  (2026-10-18)  Multi-term matching with shared candidate preparation
+//   0.4.1  (2026-10-18)  Top-k searches abandon candidates that cannot reach the results
+//   0.4.0  (2026-10-18)  Memory-mapped index files with incremental append
+//   0.3.9  (2026-10-18)  UTF-8 case folding with a vectorized ASCII fast path
+//   0.3.8  (2026-10-18)  Strings longer than 256 characters and width-templated match indices
+//   0.3.7  (2026-10-18)  Compile-time scoring profiles
+//   0.3.6  (2026-10-18)  Multi-threaded fuzzy_search_parallel
+//   0.3.5  (2026-10-18)  Optional fuzzy_postings inverted index
+//   0.3.4  (2026-10-18)  Incremental fuzzy_session for search-as-you-type
+//   0.3.3  (2026-10-18)  Precomputed fuzzy_index for repeated queries
+//   0.3.2  (2026-10-18)  Batch fuzzy_search with bounded top-k selection
+//   0.3.1  (2026-10-18)  Vectorized fuzzy_match_simple and bulk fuzzy_filter
+//   0.3.0  (2026-10-18)  Scored matches use an iterative dynamic-programming search instead of capped recursion
 //   0.2.0  (2017-02-18)  Scored matches perform exhaustive search for best score
 //   0.1.0  (2016-03-28)  Initial release
 //
@@ -17,14 +31,72 @@
 //
 //   fuzzy_match_simple(...)
 //     Returns true if each character in pattern is found sequentially within str
+//     Uses SSE2, or AVX2 when the CPU supports it, with a scalar fallback on other targets.
+//
+//   fuzzy_filter(...)
+//     Runs fuzzy_match_simple over a list of candidates with the pattern prepared once. Use it to reject candidates before scoring.
+//
+//   fuzzy_search(...)
+//     Scores a list of candidates and returns the best k, best first, in a caller-provided buffer without allocating.
+//     Once k results are held, a candidate is abandoned as soon as an optimistic bound on its score (every remaining
+//     character adjacent and on a word boundary) falls below the k-th best: before the DP from its length and first
+//     possible match, then after each DP row. Results are identical to scoring everything. The indexed overload can
+//     report how many candidates were filtered, pruned and scored in a fuzzy_search_stats.
+//
+//   fuzzy_match_ranges(...)
+//     Same match as fuzzy_match, reported as byte ranges [begin, end) with adjacent matched characters merged, ready to
+//     highlight. Written to a caller buffer; a buffer as long as the pattern always suffices. The index overload
+//     highlights search results without preparing the candidate again.
+//
+//   fuzzy_match_terms(...) / fuzzy_search_terms(...)
+//     Pattern split on spaces into up to 8 terms that must all match, in any order. The candidate is lowercased and
+//     scanned for boundaries once, then each term is scored on it; the score is the sum of the term scores.
+//
+//   fuzzy_index
+//     Candidate list lowercased and scanned for word boundaries once (fuzzy_index_build / fuzzy_index_add).
+//     fuzzy_match and fuzzy_search overloads taking an index skip all per-candidate preprocessing on repeated queries.
+//
+//   fuzzy_mapped_index
+//     A fuzzy_index saved to disk (fuzzy_index_append) and memory-mapped back (fuzzy_index_open). The file is the
+//     index arrays as laid out in memory, so opening it costs a handful of system calls however many candidates it holds,
+//     and fuzzy_match / fuzzy_search run directly on the mapped pages. New candidates are appended as another segment;
+//     a header written last marks how much of the file is committed, so a torn append is ignored on the next open.
+//     Files record a format version and are little-endian. Open fails on another version; rebuild the file then.
+//     Open also checks every candidate offset against its segment (one pass over the offsets), so a corrupt file
+//     is rejected instead of read out of bounds. Appends must pass the count the file already holds as first.
+//
+//   fuzzy_search_parallel(...)
+//     Same results as the indexed fuzzy_search, scored on a work-stealing pool of threads over shards of the index.
+//     The pool is started on first use and kept for the life of the process, so a query costs a wake-up rather than
+//     thread creation. A search issued while another one holds the pool, or when no thread can be started, runs on the
+//     threads it has (at worst the calling thread alone) with the same results.
+//
+//   fuzzy_postings
+//     Optional per-character candidate lists built on top of a fuzzy_index (fuzzy_postings_update).
+//     Searches walk only the list of the pattern's rarest character, then filter by presence bitmask before scoring.
+//
+//   fuzzy_session
+//     Search-as-you-type over an index. Each fuzzy_session_update only rescores candidates that matched the part of the
+//     pattern unchanged since the previous update; backspace reuses the surviving set of the shorter pattern.
+//     Candidates added to the index since the previous update make it start over from the first character.
 //
 //   fuzzy_match(...)
 //     Returns true if pattern is found AND calculates a score.
-//     Performs exhaustive search via recursion to find all possible matches and match with highest score.
+//     Finds the match with the highest score via dynamic programming in O(pattern * str) time using two rolling rows.
 //     Scores values have no intrinsic meaning. Possible score range is not normalized and varies with pattern.
-//     Recursion is limited internally (default=10) to prevent degenerate cases (pattern="aaaaaa" str="aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa")
-//     Uses uint8_t for match indices. Therefore patterns are limited to 256 characters.
+//     Unlike the old recursive search there is no recursion limit, so degenerate cases (pattern="aaaaaa" str="aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa") still get their optimal score.
+//     Patterns are limited to 256 characters. Strings of any length are scored; those over 256 characters use a per-thread
+//     scratch arena instead of the stack. Match indices use the type of the matches buffer: with uint8_t, positions past
+//     byte 255 do not fit; the match and its score are still reported, those positions are written as 255 and the
+//     optional matchesFit count says how many leading positions are exact. Use uint16_t or wider for long strings
+//     such as level descriptions.
+//     Strings are UTF-8. Code points of Latin-1, Latin Extended-A and Additional, Greek, Cyrillic and fullwidth Latin are
+//     case-folded with a small range table; anything else must match exactly. Pure ASCII pattern and candidate (detected
+//     16 bytes at a time) skip decoding entirely. Match indices are byte offsets of the matched code points, and the
+//     unmatched letter penalty counts code points rather than bytes.
 //     Score system should be tuned for YOUR use case. Words, sentences, file names, or method names all prefer different tuning.
+//     Tuning is done with a scoring profile template argument: fuzzy_scoring is the default, fuzzy_file_scoring treats path
+//     and extension characters as separators. Derive from fuzzy_scoring and override constants to make your own.
 
 
 #ifndef FTS_FUZZY_MATCH_H
@@ -34,185 +106,1763 @@
 #include <cstdint> // uint8_t
 #include <ctype.h> // ::tolower, ::toupper
 #include <cstring> // memcpy
+#include <algorithm> // std::push_heap, std::pop_heap, std::sort_heap
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <system_error>
+#include <limits>
 
 #include <cstdio>
 
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define FTS_FUZZY_MATCH_SSE2
+    #include <emmintrin.h>
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h> // __cpuid, _BitScanForward
+        #define FTS_FUZZY_MATCH_AVX2
+        #define FTS_FUZZY_MATCH_TARGET_AVX2
+    #elif defined(__GNUC__)
+        #define FTS_FUZZY_MATCH_AVX2
+        #define FTS_FUZZY_MATCH_TARGET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
 // Public interface
 namespace fts {
+    // Scoring profiles, passed as the template argument of the scoring functions (e.g. fts::fuzzy_match<fts::fuzzy_file_scoring>).
+    // Everything is a compile-time constant, so the compiler folds a profile into the matcher.
+    struct fuzzy_scoring {
+        static constexpr int sequential_bonus = 15;            // bonus for adjacent matches
+        static constexpr int separator_bonus = 30;             // bonus if match occurs after a separator
+        static constexpr int camel_bonus = 30;                 // bonus if match is uppercase and prev is lower
+        static constexpr int first_letter_bonus = 15;          // bonus if the first letter is matched
+
+        static constexpr int leading_letter_penalty = -5;      // penalty applied for every letter in str before the first match
+        static constexpr int max_leading_letter_penalty = -15; // maximum penalty for leading letters
+        static constexpr int unmatched_letter_penalty = -1;    // penalty for every letter that doesn't matter
+
+        static constexpr bool is_separator(char c) { return c == '_' || c == ' '; }
+    };
+
+    // File names and paths: directories, extensions and dashes also start words
+    struct fuzzy_file_scoring : fuzzy_scoring {
+        static constexpr bool is_separator(char c) { return c == '_' || c == ' ' || c == '/' || c == '\\' || c == '.' || c == '-'; }
+    };
+
     static bool fuzzy_match_simple(char const * pattern, char const * str);
-    static bool fuzzy_match(char const * pattern, char const * str, int & outScore);
-    static bool fuzzy_match(char const * pattern, char const * str, int & outScore, uint8_t * matches, int maxMatches);
+    static int fuzzy_filter(char const * pattern, char const * const * strs, int count, int * survivors);
+    template <typename Scoring = fuzzy_scoring> static bool fuzzy_match(char const * pattern, char const * str, int & outScore);
+    template <typename Scoring = fuzzy_scoring, typename Index> static bool fuzzy_match(char const * pattern, char const * str, int & outScore, Index * matches, int maxMatches,
+        int * matchesFit = nullptr);
+
+    struct fuzzy_result {
+        int index;
+        int score;
+    };
+
+    // Where the candidates of a search went. Pruned ones passed the prefilter but were abandoned once their best
+    // possible score could no longer make the results.
+    struct fuzzy_search_stats {
+        int candidates = 0;
+        int filtered = 0;
+        int pruned = 0;
+        int scored = 0;
+    };
+    template <typename Scoring = fuzzy_scoring> static int fuzzy_search(char const * pattern, char const * const * strs, int count, fuzzy_result * results, int maxResults);
+
+    // Candidates preprocessed once for repeated searches, one array per field.
+    // Candidate i occupies [offsets[i], offsets[i + 1]) of lower and boundary.
+    struct fuzzy_index {
+        std::vector<char> lower;         // case-folded UTF-8 bytes, same length as the original
+        std::vector<uint8_t> boundary;   // fuzzy_boundary flags, set on the lead byte of each code point
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> presence;  // letters and digits present in each candidate
+    };
+    static void fuzzy_index_add(fuzzy_index & index, char const * str);
+    static void fuzzy_index_build(fuzzy_index & index, char const * const * strs, int count);
+    static int fuzzy_index_size(const fuzzy_index & index);
+    template <typename Scoring = fuzzy_scoring> static bool fuzzy_match(const fuzzy_index & index, int candidate, char const * pattern, int & outScore);
+    template <typename Scoring = fuzzy_scoring> static int fuzzy_search(const fuzzy_index & index, char const * pattern, fuzzy_result * results, int maxResults,
+        fuzzy_search_stats * stats = nullptr);
+    template <typename Scoring = fuzzy_scoring> static int fuzzy_search_parallel(const fuzzy_index & index, char const * pattern, fuzzy_result * results, int maxResults, int threadCount = 0);
+    template <typename Scoring = fuzzy_scoring> static bool fuzzy_match_terms(char const * pattern, char const * str, int & outScore);
+
+    // Byte range of str to highlight
+    struct fuzzy_range {
+        int begin;
+        int end;
+    };
+    template <typename Scoring = fuzzy_scoring> static bool fuzzy_match_ranges(char const * pattern, char const * str, int & outScore,
+        fuzzy_range * ranges, int maxRanges, int & rangeCount);
+    template <typename Scoring = fuzzy_scoring> static bool fuzzy_match_ranges(const fuzzy_index & index, int candidate, char const * pattern, int & outScore,
+        fuzzy_range * ranges, int maxRanges, int & rangeCount);
+    template <typename Scoring = fuzzy_scoring> static int fuzzy_search_terms(const fuzzy_index & index, char const * pattern, fuzzy_result * results, int maxResults);
+
+    // Optional inverted index over fuzzy_index: for each presence bit, the candidates that have it, in ascending order.
+    // A query only walks the list of its rarest character instead of the whole corpus.
+    struct fuzzy_postings {
+        std::vector<uint32_t> lists[32];
+        int indexed = 0;
+    };
+    static void fuzzy_postings_update(fuzzy_postings & postings, const fuzzy_index & index);
+    static size_t fuzzy_postings_memory(const fuzzy_postings & postings);
+    template <typename Scoring = fuzzy_scoring> static int fuzzy_search(const fuzzy_index & index, const fuzzy_postings & postings, char const * pattern, fuzzy_result * results, int maxResults);
+
+    // Search-as-you-type over an index. levels[i] holds the candidates containing the first i + 1 pattern characters,
+    // with where that greedy match ended, so one more character only extends the previous level and backspace drops levels.
+    struct fuzzy_session {
+        struct survivor {
+            int candidate;
+            uint32_t end;
+        };
+
+        const fuzzy_index * index = nullptr;
+        int indexed = 0;                 // index size the levels were built from
+        std::string pattern;
+        std::vector<std::vector<survivor>> levels;
+    };
+    static void fuzzy_session_init(fuzzy_session & session, const fuzzy_index & index);
+    template <typename Scoring = fuzzy_scoring> static int fuzzy_session_update(fuzzy_session & session, char const * pattern, fuzzy_result * results, int maxResults);
+
+    // Read-only index mapped from a file written by fuzzy_index_append. Each segment points into the mapping;
+    // candidate numbers run across segments in the order they were appended.
+    struct fuzzy_mapped_index {
+        struct segment {
+            const uint32_t * offsets;    // count + 1 entries, relative to lower and boundary
+            const uint32_t * presence;
+            const char * lower;
+            const uint8_t * boundary;
+            int first;
+            int count;
+        };
+        std::vector<segment> segments;
+        int count = 0;
+        const void * view = nullptr;
+        size_t size = 0;
+    };
+    static bool fuzzy_index_append(char const * path, const fuzzy_index & index, int first = 0);
+    static bool fuzzy_index_open(fuzzy_mapped_index & mapped, char const * path);
+    static void fuzzy_index_close(fuzzy_mapped_index & mapped);
+    static int fuzzy_index_size(const fuzzy_mapped_index & mapped);
+    template <typename Scoring = fuzzy_scoring> static bool fuzzy_match(const fuzzy_mapped_index & mapped, int candidate, char const * pattern, int & outScore);
+    template <typename Scoring = fuzzy_scoring> static int fuzzy_search(const fuzzy_mapped_index & mapped, char const * pattern, fuzzy_result * results, int maxResults);
 }
 
 
 #ifdef FTS_FUZZY_MATCH_IMPLEMENTATION
+#ifdef _WIN32
+    #include <windows.h> // CreateFileMappingA, MapViewOfFile
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
 namespace fts {
 
     // Forward declarations for "private" implementation
     namespace fuzzy_internal {
-        static bool fuzzy_match_recursive(const char * pattern, const char * str, int & outScore, const char * strBegin,          
-            uint8_t const * srcMatches,  uint8_t * newMatches,  int maxMatches, int nextMatch, 
-            int & recursionCount, int recursionLimit);
+        static const int max_str_len = 256;
+        static const int no_match = -0x3fffffff;
+
+        // Case-dependent bonuses a position can earn. Separators are checked per profile against the lowercased neighbor.
+        enum fuzzy_boundary {
+            boundary_first = 1,
+            boundary_camel = 2
+        };
+
+        // Anything that is not valid UTF-8 decodes to invalid_code_point + byte, one byte at a time. Those values are
+        // outside Unicode, so a stray byte only ever matches the same stray byte.
+        static const uint32_t invalid_code_point = 0x110000;
+
+        // Pattern folded to both cases once so candidates can be compared without lowercasing them.
+        // lower holds the folded UTF-8 bytes, upper the same bytes with ASCII letters uppercased, units the folded code points.
+        struct fuzzy_pattern {
+            char lower[max_str_len];
+            char upper[max_str_len];
+            uint32_t units[max_str_len];
+            int len;
+            int unitLen;
+            bool ascii;
+        };
+
+        // Space-separated terms of a pattern, each folded on its own
+        static const int max_terms = 8;
+        struct fuzzy_terms {
+            fuzzy_pattern terms[max_terms];
+            uint32_t presence;
+            int count;
+        };
+
+        // Code points in [first, last] fold to code point + delta. Ranges with a stride of 2 alternate uppercase and
+        // lowercase, starting with an uppercase letter. Every fold keeps the UTF-8 length, so text is folded in place.
+        struct fuzzy_fold_range {
+            uint16_t first;
+            uint16_t last;
+            int16_t delta;
+            uint8_t stride;
+        };
+        static const fuzzy_fold_range fold_ranges[] = {
+            { 0x00C0, 0x00D6, 32, 1 }, { 0x00D8, 0x00DE, 32, 1 },                             // Latin-1
+            { 0x0100, 0x012E, 1, 2 }, { 0x0132, 0x0136, 1, 2 }, { 0x0139, 0x0147, 1, 2 },     // Latin Extended-A
+            { 0x014A, 0x0176, 1, 2 }, { 0x0178, 0x0178, -121, 1 }, { 0x0179, 0x017D, 1, 2 },
+            { 0x0386, 0x0386, 38, 1 }, { 0x0388, 0x038A, 37, 1 }, { 0x038C, 0x038C, 64, 1 },  // Greek
+            { 0x038E, 0x038F, 63, 1 }, { 0x0391, 0x03A1, 32, 1 }, { 0x03A3, 0x03AB, 32, 1 },
+            { 0x0400, 0x040F, 80, 1 }, { 0x0410, 0x042F, 32, 1 },                             // Cyrillic
+            { 0x0460, 0x0480, 1, 2 }, { 0x048A, 0x04BE, 1, 2 },
+            { 0x1E00, 0x1E94, 1, 2 }, { 0x1EA0, 0x1EFE, 1, 2 },                               // Latin Extended Additional
+            { 0xFF21, 0xFF3A, 32, 1 }                                                         // Fullwidth Latin
+        };
+
+        // Checks pattern[i, len) against str[j, strLen)
+        typedef bool (*fuzzy_subsequence_fn)(const fuzzy_pattern & pattern, int i, const char * str, int j, int strLen);
+
+        static char fuzzy_lower(char c);
+        static bool fuzzy_is_ascii(const char * str, int len);
+        static int fuzzy_decode(const char * str, int len, uint32_t & codepoint);
+        static uint32_t fuzzy_fold(uint32_t codepoint);
+        static bool fuzzy_is_lower(uint32_t codepoint);
+        static int fuzzy_fold_next(const char * str, int len, char * lower, uint32_t & codepoint, uint32_t & folded);
+        static int fuzzy_units(const char * lower, const uint8_t * boundary, int len, uint32_t * units, uint8_t * unitBoundary, int * offsets);
+        static char fuzzy_ascii(char c);
+        static char fuzzy_ascii(uint32_t codepoint);
+        static bool fuzzy_pattern_init(fuzzy_pattern & out, const char * pattern);
+        static bool fuzzy_terms_init(fuzzy_terms & out, const char * pattern);
+        static int fuzzy_coalesce(const char * str, int strLen, const int * positions, int count, fuzzy_range * ranges, int maxRanges);
+        template <typename Scoring> static bool fuzzy_score_terms(const fuzzy_terms & terms, const char * lower, const uint8_t * boundary, int strLen, int & outScore);
+        static bool fuzzy_subsequence_scalar(const fuzzy_pattern & pattern, int i, const char * str, int j, int strLen);
+#ifdef FTS_FUZZY_MATCH_SSE2
+        static int fuzzy_ctz(unsigned int mask);
+        static bool fuzzy_subsequence_sse2(const fuzzy_pattern & pattern, int i, const char * str, int j, int strLen);
+#endif
+#ifdef FTS_FUZZY_MATCH_AVX2
+        static bool fuzzy_has_avx2();
+        FTS_FUZZY_MATCH_TARGET_AVX2 static bool fuzzy_subsequence_avx2(const fuzzy_pattern & pattern, int i, const char * str, int j, int strLen);
+#endif
+        static fuzzy_subsequence_fn fuzzy_subsequence();
+        static bool fuzzy_subsequence_utf8(const fuzzy_pattern & pattern, const char * str, int strLen);
+        static bool fuzzy_prefilter(const fuzzy_pattern & pattern, const char * str, int strLen);
+        template <typename Scoring, typename Unit> static int fuzzy_bonus(const Unit * lower, const uint8_t * boundary, int j);
+        static uint32_t fuzzy_presence(char lower);
+        static void fuzzy_prepare(const char * str, int len, char * lower, uint8_t * boundary);
+        template <typename Unit> static bool fuzzy_bounds(const Unit * pattern, int patternLen, const Unit * lower, int strLen, int * lo, int * hi);
+        template <typename Scoring> static constexpr int fuzzy_max_boundary_bonus();
+        template <typename Scoring> static constexpr int fuzzy_max_bonus();
+        template <typename Scoring> static int fuzzy_first_max(int first);
+        template <typename Scoring, typename Unit> static bool fuzzy_score_rows(const Unit * pattern, int rowCount, const Unit * lower, const uint8_t * boundary,
+            const int * lo, const int * hi, int * row, int * scratch, int floor);
+        template <typename Scoring, typename Unit> static bool fuzzy_score_units(const Unit * pattern, int patternLen, const Unit * lower, const uint8_t * boundary,
+            int strLen, int & outScore, int * matches, int minScore, fuzzy_search_stats * stats);
+        template <typename Scoring> static bool fuzzy_score_prepared(const fuzzy_pattern & folded, const char * lower, const uint8_t * boundary, int strLen,
+            int & outScore, int * matches, int maxMatches, int minScore = no_match, fuzzy_search_stats * stats = nullptr);
+        template <typename Scoring> static bool fuzzy_match_dp(const fuzzy_pattern & folded, const char * str, int & outScore, int * matches, int maxMatches,
+            int minScore = no_match);
+        template <typename T, int Slot> static T * fuzzy_arena(size_t count);
+        template <typename Scoring> static bool fuzzy_match_indexed(const fuzzy_index & index, int candidate, const fuzzy_pattern & folded, uint32_t presence, int & outScore,
+            int minScore = no_match, fuzzy_search_stats * stats = nullptr);
+        static bool fuzzy_result_better(const fuzzy_result & a, const fuzzy_result & b);
+        static void fuzzy_push_result(fuzzy_result * results, int & resultCount, int maxResults, fuzzy_result result);
+        static int fuzzy_min_score(const fuzzy_result * results, int resultCount, int maxResults, int candidate);
+
+        // Shards owned by one worker. Owner and thieves both claim from "next", so no shard is scored twice.
+        struct fuzzy_shard_range {
+            std::atomic<int> next;
+            int end;
+        };
+        static const int shard_size = 4096;
+        static int fuzzy_claim_shard(std::vector<fuzzy_shard_range> & ranges, int self);
+
+        // Threads reused across parallel searches. A job runs as worker 0 on the caller and 1..jobWorkers on the pool;
+        // "busy" is held by the search that owns the pool for the whole job.
+        typedef void (*fuzzy_job_fn)(void * context, int worker);
+        struct fuzzy_pool {
+            std::mutex busy;
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::condition_variable done;
+            std::vector<std::thread> threads;
+            fuzzy_job_fn job = nullptr;
+            void * context = nullptr;
+            unsigned generation = 0;
+            int jobWorkers = 0;
+            int pending = 0;
+        };
+        static fuzzy_pool & fuzzy_thread_pool();
+        static void fuzzy_pool_thread(fuzzy_pool & pool, int worker, unsigned generation);
+        static void fuzzy_pool_run(fuzzy_pool & pool, int workers, fuzzy_job_fn job, void * context);
+
+        // Index file layout. Bump index_file_version whenever the folding or flags stored in fuzzy_index change.
+        // Each segment is a fuzzy_segment_header followed by offsets[count + 1], presence[count], lower[bytes] and
+        // boundary[bytes], padded to 4 bytes. Only the first "end" bytes of the file are committed.
+        static const char index_file_magic[4] = { 'F', 'T', 'S', 'I' };
+        static const uint32_t index_file_version = 1;
+        struct fuzzy_file_header {
+            char magic[4];
+            uint32_t version;
+            uint32_t count;
+            uint32_t end;
+        };
+        struct fuzzy_segment_header {
+            uint32_t count;
+            uint32_t bytes;
+        };
+        static unsigned long long fuzzy_segment_size(uint32_t count, uint32_t bytes);
+        template <typename Scoring> static bool fuzzy_match_candidate(const fuzzy_pattern & folded, uint32_t presence, uint32_t candidatePresence,
+            const char * lower, const uint8_t * boundary, int strLen, int & outScore, int minScore = no_match, fuzzy_search_stats * stats = nullptr);
     }
 
     // Public interface
     static bool fuzzy_match_simple(char const * pattern, char const * str) {
-        while (*pattern != '\0' && *str != '\0')  {
-            if (tolower(*pattern) == tolower(*str))
-                ++pattern;
-            ++str;
+        fuzzy_internal::fuzzy_pattern folded;
+        if (!fuzzy_internal::fuzzy_pattern_init(folded, pattern)) {
+            // Pattern too long to fold, walk it directly
+            while (*pattern != '\0' && *str != '\0')  {
+                if (fuzzy_internal::fuzzy_lower(*pattern) == fuzzy_internal::fuzzy_lower(*str))
+                    ++pattern;
+                ++str;
+            }
+            return *pattern == '\0' ? true : false;
+        }
+
+        return fuzzy_internal::fuzzy_prefilter(folded, str, (int)strlen(str));
+    }
+
+    // Writes the indices of strs that contain pattern as a subsequence into survivors and returns how many there are.
+    // Use it to reject candidates in bulk before scoring them with fuzzy_match.
+    static int fuzzy_filter(char const * pattern, char const * const * strs, int count, int * survivors) {
+        fuzzy_internal::fuzzy_pattern folded;
+        int survivorCount = 0;
+
+        if (!fuzzy_internal::fuzzy_pattern_init(folded, pattern)) {
+            for (int i = 0; i < count; ++i) {
+                if (fuzzy_match_simple(pattern, strs[i]))
+                    survivors[survivorCount++] = i;
+            }
+            return survivorCount;
         }
 
-        return *pattern == '\0' ? true : false;
+        for (int i = 0; i < count; ++i) {
+            if (fuzzy_internal::fuzzy_prefilter(folded, strs[i], (int)strlen(strs[i])))
+                survivors[survivorCount++] = i;
+        }
+        return survivorCount;
     }
 
-    static bool fuzzy_match(char const * pattern, char const * str, int & outScore) {
-        
-        uint8_t matches[256];
-        return fuzzy_match(pattern, str, outScore, matches, sizeof(matches));
+    template <typename Scoring> static bool fuzzy_match(char const * pattern, char const * str, int & outScore) {
+        fuzzy_internal::fuzzy_pattern folded;
+        return fuzzy_internal::fuzzy_pattern_init(folded, pattern)
+            && fuzzy_internal::fuzzy_match_dp<Scoring>(folded, str, outScore, nullptr, fuzzy_internal::max_str_len);
     }
 
-    static bool fuzzy_match(char const * pattern, char const * str, int & outScore, uint8_t * matches, int maxMatches) {
-        int recursionCount = 0;
-        int recursionLimit = 10;
+    // matches receives the byte offset of each matched pattern character (code point).
+    // Index is the type of the reported match positions. Positions that do not fit in Index are written as its maximum;
+    // matchesFit, if given, receives how many leading positions are exact (positions only grow, so the rest all overflow).
+    template <typename Scoring, typename Index> static bool fuzzy_match(char const * pattern, char const * str, int & outScore, Index * matches, int maxMatches,
+        int * matchesFit)
+    {
+        fuzzy_internal::fuzzy_pattern folded;
+        int positions[fuzzy_internal::max_str_len];
+        if (!fuzzy_internal::fuzzy_pattern_init(folded, pattern)
+            || !fuzzy_internal::fuzzy_match_dp<Scoring>(folded, str, outScore, positions, maxMatches))
+            return false;
 
-        return fuzzy_internal::fuzzy_match_recursive(pattern, str, outScore, str, nullptr, matches, maxMatches, 0, recursionCount, recursionLimit);
+        const unsigned long long largest = (unsigned long long)(std::numeric_limits<Index>::max)();
+        int fit = 0;
+        for (int i = 0; i < folded.unitLen; ++i) {
+            if ((unsigned long long)positions[i] <= largest) {
+                matches[i] = (Index)positions[i];
+                ++fit;
+            }
+            else {
+                matches[i] = (std::numeric_limits<Index>::max)();
+            }
+        }
+
+        if (matchesFit)
+            *matchesFit = fit;
+        return true;
     }
 
-    // Private implementation
-    static bool fuzzy_internal::fuzzy_match_recursive(const char * pattern, const char * str, int & outScore, 
-        const char * strBegin, uint8_t const * srcMatches, uint8_t * matches, int maxMatches, 
-        int nextMatch, int & recursionCount, int recursionLimit)
+    // Scores every candidate and keeps the best maxResults in results, best first (ties go to the lower index).
+    // Candidates are handled in chunks: each chunk is prefiltered in bulk, then only the survivors are scored.
+    // Returns the number of results written. Nothing is allocated.
+    template <typename Scoring> static int fuzzy_search(char const * pattern, char const * const * strs, int count, fuzzy_result * results, int maxResults) {
+        fuzzy_internal::fuzzy_pattern folded;
+        if (maxResults <= 0 || !fuzzy_internal::fuzzy_pattern_init(folded, pattern))
+            return 0;
+
+        const int chunk_size = 256;
+        int survivors[chunk_size];
+        int resultCount = 0;
+
+        for (int chunk = 0; chunk < count; chunk += chunk_size) {
+            int chunkEnd = (count - chunk < chunk_size) ? count : chunk + chunk_size;
+
+            int survivorCount = 0;
+            for (int i = chunk; i < chunkEnd; ++i) {
+                if (fuzzy_internal::fuzzy_prefilter(folded, strs[i], (int)strlen(strs[i])))
+                    survivors[survivorCount++] = i;
+            }
+
+            for (int s = 0; s < survivorCount; ++s) {
+                fuzzy_result result = { survivors[s], 0 };
+                int minScore = fuzzy_internal::fuzzy_min_score(results, resultCount, maxResults, result.index);
+                if (fuzzy_internal::fuzzy_match_dp<Scoring>(folded, strs[result.index], result.score, nullptr, fuzzy_internal::max_str_len, minScore))
+                    fuzzy_internal::fuzzy_push_result(results, resultCount, maxResults, result);
+            }
+        }
+
+        std::sort_heap(results, results + resultCount, fuzzy_internal::fuzzy_result_better);
+        return resultCount;
+    }
+
+    // Fails if the match needs more than maxRanges ranges
+    template <typename Scoring> static bool fuzzy_match_ranges(char const * pattern, char const * str, int & outScore,
+        fuzzy_range * ranges, int maxRanges, int & rangeCount)
     {
-        // Count recursions
-        ++recursionCount;
-        if (recursionCount >= recursionLimit)
-            return false;
-
-        // Detect end of strings
-        if (*pattern == '\0' || *str == '\0')
-            return false;
-
-        // Recursion params
-        bool recursiveMatch = false;
-        uint8_t bestRecursiveMatches[256];
-        int bestRecursiveScore = 0;
-
-        // Loop through pattern and str looking for a match
-        bool first_match = true;
-        while (*pattern != '\0' && *str != '\0') {
-            
-            // Found match
-            if (tolower(*pattern) == tolower(*str)) {
-
-                // Supplied matches buffer was too short
-                if (nextMatch >= maxMatches)
-                    return false;
-                
-                // "Copy-on-Write" srcMatches into matches
-                if (first_match && srcMatches) {
-                    memcpy(matches, srcMatches, nextMatch);
-                    first_match = false;
+        fuzzy_internal::fuzzy_pattern folded;
+        int positions[fuzzy_internal::max_str_len];
+        if (!fuzzy_internal::fuzzy_pattern_init(folded, pattern)
+            || !fuzzy_internal::fuzzy_match_dp<Scoring>(folded, str, outScore, positions, fuzzy_internal::max_str_len))
+            return false;
+
+        rangeCount = fuzzy_internal::fuzzy_coalesce(str, (int)strlen(str), positions, folded.unitLen, ranges, maxRanges);
+        return rangeCount >= 0;
+    }
+
+    // Folding keeps every code point's length, so ranges found in the index apply to the original string
+    template <typename Scoring> static bool fuzzy_match_ranges(const fuzzy_index & index, int candidate, char const * pattern, int & outScore,
+        fuzzy_range * ranges, int maxRanges, int & rangeCount)
+    {
+        fuzzy_internal::fuzzy_pattern folded;
+        int positions[fuzzy_internal::max_str_len];
+        if (!fuzzy_internal::fuzzy_pattern_init(folded, pattern))
+            return false;
+
+        uint32_t start = index.offsets[candidate];
+        int strLen = (int)(index.offsets[candidate + 1] - start);
+        const char * lower = index.lower.data() + start;
+        if (!fuzzy_internal::fuzzy_score_prepared<Scoring>(folded, lower, index.boundary.data() + start, strLen, outScore,
+                positions, fuzzy_internal::max_str_len))
+            return false;
+
+        rangeCount = fuzzy_internal::fuzzy_coalesce(lower, strLen, positions, folded.unitLen, ranges, maxRanges);
+        return rangeCount >= 0;
+    }
+
+    // Every term must match; the score is the sum of the term scores. Terms are rejected with the raw prefilter first,
+    // then the candidate is prepared once for all of them.
+    template <typename Scoring> static bool fuzzy_match_terms(char const * pattern, char const * str, int & outScore) {
+        fuzzy_internal::fuzzy_terms terms;
+        size_t rawLen = strlen(str);
+        if (!fuzzy_internal::fuzzy_terms_init(terms, pattern) || rawLen > (size_t)(std::numeric_limits<int>::max)())
+            return false;
+
+        for (int t = 0; t < terms.count; ++t) {
+            if (!fuzzy_internal::fuzzy_prefilter(terms.terms[t], str, (int)rawLen))
+                return false;
+        }
+
+        char lowerStack[fuzzy_internal::max_str_len];
+        uint8_t boundaryStack[fuzzy_internal::max_str_len];
+        char * lower = lowerStack;
+        uint8_t * boundary = boundaryStack;
+        if (rawLen > (size_t)fuzzy_internal::max_str_len) {
+            lower = fuzzy_internal::fuzzy_arena<char, 0>(rawLen);
+            boundary = fuzzy_internal::fuzzy_arena<uint8_t, 0>(rawLen);
+        }
+
+        fuzzy_internal::fuzzy_prepare(str, (int)rawLen, lower, boundary);
+        return fuzzy_internal::fuzzy_score_terms<Scoring>(terms, lower, boundary, (int)rawLen, outScore);
+    }
+
+    template <typename Scoring> static int fuzzy_search_terms(const fuzzy_index & index, char const * pattern, fuzzy_result * results, int maxResults) {
+        fuzzy_internal::fuzzy_terms terms;
+        if (maxResults <= 0 || !fuzzy_internal::fuzzy_terms_init(terms, pattern))
+            return 0;
+
+        int resultCount = 0;
+        int count = fuzzy_index_size(index);
+        for (int i = 0; i < count; ++i) {
+            if ((index.presence[i] & terms.presence) != terms.presence)
+                continue;
+
+            uint32_t start = index.offsets[i];
+            fuzzy_result result = { i, 0 };
+            if (fuzzy_internal::fuzzy_score_terms<Scoring>(terms, index.lower.data() + start, index.boundary.data() + start,
+                    (int)(index.offsets[i + 1] - start), result.score))
+                fuzzy_internal::fuzzy_push_result(results, resultCount, maxResults, result);
+        }
+
+        std::sort_heap(results, results + resultCount, fuzzy_internal::fuzzy_result_better);
+        return resultCount;
+    }
+
+    static void fuzzy_index_add(fuzzy_index & index, char const * str) {
+        if (index.offsets.empty())
+            index.offsets.push_back(0);
+
+        size_t start = index.lower.size();
+        size_t len = strlen(str);
+        index.lower.resize(start + len);
+        index.boundary.resize(start + len);
+        fuzzy_internal::fuzzy_prepare(str, (int)len, index.lower.data() + start, index.boundary.data() + start);
+
+        uint32_t presence = 0;
+        for (size_t i = start; i < start + len; ++i)
+            presence |= fuzzy_internal::fuzzy_presence(index.lower[i]);
+
+        index.offsets.push_back((uint32_t)(start + len));
+        index.presence.push_back(presence);
+    }
+
+    static void fuzzy_index_build(fuzzy_index & index, char const * const * strs, int count) {
+        size_t total = 0;
+        for (int i = 0; i < count; ++i)
+            total += strlen(strs[i]);
+
+        index.lower.reserve(index.lower.size() + total);
+        index.boundary.reserve(index.boundary.size() + total);
+        index.offsets.reserve(index.offsets.size() + count + 1);
+        index.presence.reserve(index.presence.size() + count);
+
+        for (int i = 0; i < count; ++i)
+            fuzzy_index_add(index, strs[i]);
+    }
+
+    static void fuzzy_session_init(fuzzy_session & session, const fuzzy_index & index) {
+        session.index = &index;
+        session.indexed = fuzzy_index_size(index);
+        session.pattern.clear();
+        session.levels.clear();
+    }
+
+    // Rescores only the candidates that survived the longest unchanged prefix of the previous pattern
+    template <typename Scoring> static int fuzzy_session_update(fuzzy_session & session, char const * pattern, fuzzy_result * results, int maxResults) {
+        const fuzzy_index & index = *session.index;
+
+        fuzzy_internal::fuzzy_pattern folded;
+        if (!fuzzy_internal::fuzzy_pattern_init(folded, pattern))
+            return 0;
+
+        // Levels only know the candidates that existed when they were built
+        if (session.indexed != fuzzy_index_size(index)) {
+            session.indexed = fuzzy_index_size(index);
+            session.pattern.clear();
+            session.levels.clear();
+        }
+
+        // Keep the levels of the prefix shared with the previous pattern
+        size_t kept = 0;
+        while (kept < session.pattern.size() && kept < (size_t)folded.len && session.pattern[kept] == folded.lower[kept])
+            ++kept;
+        session.levels.resize(kept);
+        session.pattern.assign(folded.lower, folded.len);
+
+        for (int i = (int)kept; i < folded.len; ++i) {
+            char c = folded.lower[i];
+            std::vector<fuzzy_session::survivor> level;
+
+            if (i == 0) {
+                uint32_t presence = fuzzy_internal::fuzzy_presence(c);
+                for (int candidate = 0; candidate < fuzzy_index_size(index); ++candidate) {
+                    if ((index.presence[candidate] & presence) != presence)
+                        continue;
+                    const char * begin = index.lower.data() + index.offsets[candidate];
+                    const void * found = memchr(begin, c, index.offsets[candidate + 1] - index.offsets[candidate]);
+                    if (found)
+                        level.push_back({ candidate, (uint32_t)((const char *)found - begin) + 1 });
                 }
+            }
+            else {
+                // Resume each greedy match where the previous character left it
+                const std::vector<fuzzy_session::survivor> & previous = session.levels[i - 1];
+                level.reserve(previous.size());
+                for (const fuzzy_session::survivor & entry : previous) {
+                    const char * begin = index.lower.data() + index.offsets[entry.candidate];
+                    uint32_t len = index.offsets[entry.candidate + 1] - index.offsets[entry.candidate];
+                    const void * found = memchr(begin + entry.end, c, len - entry.end);
+                    if (found)
+                        level.push_back({ entry.candidate, (uint32_t)((const char *)found - begin) + 1 });
+                }
+            }
 
-                // Recursive call that "skips" this match
-                uint8_t recursiveMatches[256];
-                int recursiveScore;
-                if (fuzzy_match_recursive(pattern, str + 1, recursiveScore, strBegin, matches, recursiveMatches, sizeof(recursiveMatches), nextMatch, recursionCount, recursionLimit)) {
-                    
-                    // Pick best recursive score
-                    if (!recursiveMatch || recursiveScore > bestRecursiveScore) {
-                        memcpy(bestRecursiveMatches, recursiveMatches, 256);
-                        bestRecursiveScore = recursiveScore;
-                    }
-                    recursiveMatch = true;
+            session.levels.push_back(std::move(level));
+        }
+
+        if (folded.len == 0 || maxResults <= 0)
+            return 0;
+
+        int resultCount = 0;
+        for (const fuzzy_session::survivor & entry : session.levels.back()) {
+            uint32_t start = index.offsets[entry.candidate];
+            int strLen = (int)(index.offsets[entry.candidate + 1] - start);
+            fuzzy_result result = { entry.candidate, 0 };
+            if (fuzzy_internal::fuzzy_score_prepared<Scoring>(folded, index.lower.data() + start, index.boundary.data() + start, strLen, result.score,
+                    nullptr, fuzzy_internal::max_str_len, fuzzy_internal::fuzzy_min_score(results, resultCount, maxResults, result.index)))
+                fuzzy_internal::fuzzy_push_result(results, resultCount, maxResults, result);
+        }
+
+        std::sort_heap(results, results + resultCount, fuzzy_internal::fuzzy_result_better);
+        return resultCount;
+    }
+
+    // Splits the index into shards spread evenly over the workers. A worker that runs out of its own shards steals from
+    // the others, and each keeps its own top-k heap. Heaps are merged with the same (score, index) ordering as
+    // fuzzy_search, so results do not depend on thread count or timing. threadCount <= 0 uses every hardware thread.
+    template <typename Scoring> static int fuzzy_search_parallel(const fuzzy_index & index, char const * pattern, fuzzy_result * results, int maxResults, int threadCount) {
+        fuzzy_internal::fuzzy_pattern folded;
+        if (maxResults <= 0 || !fuzzy_internal::fuzzy_pattern_init(folded, pattern))
+            return 0;
+
+        uint32_t presence = 0;
+        for (int i = 0; i < folded.len; ++i)
+            presence |= fuzzy_internal::fuzzy_presence(folded.lower[i]);
+
+        int count = fuzzy_index_size(index);
+        int shardCount = (count + fuzzy_internal::shard_size - 1) / fuzzy_internal::shard_size;
+        if (threadCount <= 0)
+            threadCount = (int)std::thread::hardware_concurrency();
+        if (threadCount > shardCount)
+            threadCount = shardCount;
+        if (threadCount <= 1)
+            return fuzzy_search<Scoring>(index, pattern, results, maxResults);
+
+        fuzzy_internal::fuzzy_pool & pool = fuzzy_internal::fuzzy_thread_pool();
+        std::unique_lock<std::mutex> busy(pool.busy, std::try_to_lock);
+        if (!busy)
+            return fuzzy_search<Scoring>(index, pattern, results, maxResults);
+
+        std::vector<fuzzy_internal::fuzzy_shard_range> ranges(threadCount);
+        for (int t = 0; t < threadCount; ++t) {
+            ranges[t].next = (int)((long long)shardCount * t / threadCount);
+            ranges[t].end = (int)((long long)shardCount * (t + 1) / threadCount);
+        }
+
+        std::vector<std::vector<fuzzy_result>> heaps(threadCount, std::vector<fuzzy_result>(maxResults));
+        std::vector<int> heapSizes(threadCount, 0);
+
+        auto worker = [&](int self) {
+            fuzzy_result * heap = heaps[self].data();
+            for (int shard; (shard = fuzzy_internal::fuzzy_claim_shard(ranges, self)) >= 0; ) {
+                int end = (shard + 1) * fuzzy_internal::shard_size;
+                if (end > count)
+                    end = count;
+
+                for (int i = shard * fuzzy_internal::shard_size; i < end; ++i) {
+                    fuzzy_result result = { i, 0 };
+                    int minScore = fuzzy_internal::fuzzy_min_score(heap, heapSizes[self], maxResults, i);
+                    if (fuzzy_internal::fuzzy_match_indexed<Scoring>(index, i, folded, presence, result.score, minScore))
+                        fuzzy_internal::fuzzy_push_result(heap, heapSizes[self], maxResults, result);
                 }
+            }
+        };
 
-                // Advance
-                matches[nextMatch++] = (uint8_t)(str - strBegin);
-                ++pattern;
+        // Workers that could not be started leave their ranges to be stolen by the others
+        fuzzy_internal::fuzzy_pool_run(pool, threadCount, [](void * context, int self) { (*(decltype(worker) *)context)(self); }, &worker);
+
+        int resultCount = 0;
+        for (int t = 0; t < threadCount; ++t) {
+            for (int i = 0; i < heapSizes[t]; ++i)
+                fuzzy_internal::fuzzy_push_result(results, resultCount, maxResults, heaps[t][i]);
+        }
+
+        std::sort_heap(results, results + resultCount, fuzzy_internal::fuzzy_result_better);
+        return resultCount;
+    }
+
+    // Adds the candidates appended to index since the last update
+    static void fuzzy_postings_update(fuzzy_postings & postings, const fuzzy_index & index) {
+        int count = fuzzy_index_size(index);
+        for (; postings.indexed < count; ++postings.indexed) {
+            uint32_t presence = index.presence[postings.indexed];
+            for (int bit = 0; bit < 32; ++bit) {
+                if (presence & (1u << bit))
+                    postings.lists[bit].push_back((uint32_t)postings.indexed);
             }
-            ++str;
         }
+    }
+
+    static size_t fuzzy_postings_memory(const fuzzy_postings & postings) {
+        size_t bytes = sizeof(postings);
+        for (int bit = 0; bit < 32; ++bit)
+            bytes += postings.lists[bit].capacity() * sizeof(uint32_t);
+        return bytes;
+    }
 
-        // Determine if full pattern was matched
-        bool matched = *pattern == '\0' ? true : false;
+    template <typename Scoring> static int fuzzy_search(const fuzzy_index & index, const fuzzy_postings & postings, char const * pattern, fuzzy_result * results, int maxResults) {
+        fuzzy_internal::fuzzy_pattern folded;
+        if (maxResults <= 0 || !fuzzy_internal::fuzzy_pattern_init(folded, pattern))
+            return 0;
 
-        // Calculate score
-        if (matched) {
-            const int sequential_bonus = 15;            // bonus for adjacent matches
-            const int separator_bonus = 30;             // bonus if match occurs after a separator
-            const int camel_bonus = 30;                 // bonus if match is uppercase and prev is lower
-            const int first_letter_bonus = 15;          // bonus if the first letter is matched
+        uint32_t presence = 0;
+        for (int i = 0; i < folded.len; ++i)
+            presence |= fuzzy_internal::fuzzy_presence(folded.lower[i]);
 
-            const int leading_letter_penalty = -5;      // penalty applied for every letter in str before the first match
-            const int max_leading_letter_penalty = -15; // maximum penalty for leading letters
-            const int unmatched_letter_penalty = -1;    // penalty for every letter that doesn't matter
+        // Patterns made only of untracked characters get no help from the postings
+        if (presence == 0 || postings.indexed < fuzzy_index_size(index))
+            return fuzzy_search<Scoring>(index, pattern, results, maxResults);
 
-            // Iterate str to end
-            while (*str != '\0')
-                ++str;
+        const std::vector<uint32_t> * rarest = nullptr;
+        for (int bit = 0; bit < 32; ++bit) {
+            if ((presence & (1u << bit)) && (!rarest || postings.lists[bit].size() < rarest->size()))
+                rarest = &postings.lists[bit];
+        }
+
+        int resultCount = 0;
+        for (uint32_t candidate : *rarest) {
+            fuzzy_result result = { (int)candidate, 0 };
+            int minScore = fuzzy_internal::fuzzy_min_score(results, resultCount, maxResults, result.index);
+            if (fuzzy_internal::fuzzy_match_indexed<Scoring>(index, result.index, folded, presence, result.score, minScore))
+                fuzzy_internal::fuzzy_push_result(results, resultCount, maxResults, result);
+        }
+
+        std::sort_heap(results, results + resultCount, fuzzy_internal::fuzzy_result_better);
+        return resultCount;
+    }
+
+    static int fuzzy_index_size(const fuzzy_index & index) {
+        return (int)index.presence.size();
+    }
+
+    template <typename Scoring> static bool fuzzy_match(const fuzzy_index & index, int candidate, char const * pattern, int & outScore) {
+        fuzzy_internal::fuzzy_pattern folded;
+        if (!fuzzy_internal::fuzzy_pattern_init(folded, pattern))
+            return false;
+
+        uint32_t presence = 0;
+        for (int i = 0; i < folded.len; ++i)
+            presence |= fuzzy_internal::fuzzy_presence(folded.lower[i]);
+
+        return fuzzy_internal::fuzzy_match_indexed<Scoring>(index, candidate, folded, presence, outScore);
+    }
+
+    // Same as the list overload but nothing is lowercased or scanned for boundaries per candidate
+    template <typename Scoring> static int fuzzy_search(const fuzzy_index & index, char const * pattern, fuzzy_result * results, int maxResults,
+        fuzzy_search_stats * stats)
+    {
+        fuzzy_internal::fuzzy_pattern folded;
+        if (maxResults <= 0 || !fuzzy_internal::fuzzy_pattern_init(folded, pattern))
+            return 0;
+
+        uint32_t presence = 0;
+        for (int i = 0; i < folded.len; ++i)
+            presence |= fuzzy_internal::fuzzy_presence(folded.lower[i]);
+
+        int resultCount = 0;
+        int count = fuzzy_index_size(index);
+        for (int i = 0; i < count; ++i) {
+            fuzzy_result result = { i, 0 };
+            int minScore = fuzzy_internal::fuzzy_min_score(results, resultCount, maxResults, i);
+            if (fuzzy_internal::fuzzy_match_indexed<Scoring>(index, i, folded, presence, result.score, minScore, stats))
+                fuzzy_internal::fuzzy_push_result(results, resultCount, maxResults, result);
+        }
+
+        std::sort_heap(results, results + resultCount, fuzzy_internal::fuzzy_result_better);
+        return resultCount;
+    }
+
+    // Writes candidates [first, size) of index after the committed part of the file at path, creating it if needed.
+    // first must be the number of candidates the file already holds, so nothing is skipped or written twice.
+    // The header is only updated once the new segment is written. Returns false on I/O errors, on a mismatched first,
+    // or if the file has another format version.
+    static bool fuzzy_index_append(char const * path, const fuzzy_index & index, int first) {
+        int count = fuzzy_index_size(index);
+        if (first < 0 || first > count)
+            return false;
+
+        fuzzy_internal::fuzzy_file_header header;
+        FILE * file = fopen(path, "r+b");
+        bool created = !file;
+        if (file) {
+            if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, fuzzy_internal::index_file_magic, 4) != 0
+                || header.version != fuzzy_internal::index_file_version)
+            {
+                fclose(file);
+                return false;
+            }
+        }
+        else {
+            file = fopen(path, "w+b");
+            if (!file)
+                return false;
+            memcpy(header.magic, fuzzy_internal::index_file_magic, 4);
+            header.version = fuzzy_internal::index_file_version;
+            header.count = 0;
+            header.end = sizeof(header);
+        }
+
+        if ((uint32_t)first != header.count) {
+            fclose(file);
+            return false;
+        }
+
+        // Nothing to add; a new file still gets its empty header. Switching from reading to writing needs a seek.
+        if (first == count) {
+            bool ok = !created || (fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1);
+            return fclose(file) == 0 && ok;
+        }
+
+        uint32_t base = index.offsets[first];
+        fuzzy_internal::fuzzy_segment_header segment = { (uint32_t)(count - first), index.offsets[count] - base };
+        unsigned long long segmentSize = fuzzy_internal::fuzzy_segment_size(segment.count, segment.bytes);
+        if (header.end + segmentSize > 0xFFFFFFFFull) {
+            fclose(file);
+            return false;
+        }
+
+        std::vector<uint32_t> offsets(index.offsets.begin() + first, index.offsets.end());
+        for (uint32_t & offset : offsets)
+            offset -= base;
+
+        static const char padding[4] = {};
+        size_t written = sizeof(segment) + offsets.size() * sizeof(uint32_t) + segment.count * sizeof(uint32_t) + segment.bytes * 2;
+        bool ok = fseek(file, (long)header.end, SEEK_SET) == 0
+            && fwrite(&segment, sizeof(segment), 1, file) == 1
+            && fwrite(offsets.data(), sizeof(uint32_t), offsets.size(), file) == offsets.size()
+            && fwrite(index.presence.data() + first, sizeof(uint32_t), segment.count, file) == segment.count
+            && fwrite(index.lower.data() + base, 1, segment.bytes, file) == segment.bytes
+            && fwrite(index.boundary.data() + base, 1, segment.bytes, file) == segment.bytes
+            && fwrite(padding, 1, (size_t)segmentSize - written, file) == (size_t)segmentSize - written
+            && fflush(file) == 0;
+
+        // Commit: a crash before this point leaves the previous header, which does not cover the partial segment
+        if (ok) {
+            header.count += segment.count;
+            header.end += (uint32_t)segmentSize;
+            ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        }
+        return fclose(file) == 0 && ok;
+    }
+
+    // Maps the file at path and points the segments into it. Nothing is copied.
+    static bool fuzzy_index_open(fuzzy_mapped_index & mapped, char const * path) {
+        fuzzy_index_close(mapped);
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= (LONGLONG)sizeof(fuzzy_internal::fuzzy_file_header))
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping)
+            return false;
+
+        // The view keeps the mapping alive on its own
+        mapped.view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!mapped.view)
+            return false;
+        mapped.size = (size_t)fileSize.QuadPart;
+#else
+        int file = open(path, O_RDONLY);
+        if (file < 0)
+            return false;
+
+        struct stat info;
+        void * view = MAP_FAILED;
+        if (fstat(file, &info) == 0 && info.st_size >= (off_t)sizeof(fuzzy_internal::fuzzy_file_header))
+            view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+        close(file);
+        if (view == MAP_FAILED)
+            return false;
+
+        mapped.view = view;
+        mapped.size = (size_t)info.st_size;
+#endif
+
+        const char * base = (const char *)mapped.view;
+        const fuzzy_internal::fuzzy_file_header * header = (const fuzzy_internal::fuzzy_file_header *)base;
+        if (memcmp(header->magic, fuzzy_internal::index_file_magic, 4) != 0 || header->version != fuzzy_internal::index_file_version
+            || header->end > mapped.size)
+        {
+            fuzzy_index_close(mapped);
+            return false;
+        }
+
+        size_t at = sizeof(fuzzy_internal::fuzzy_file_header);
+        while (at < header->end) {
+            const fuzzy_internal::fuzzy_segment_header * segmentHeader = (const fuzzy_internal::fuzzy_segment_header *)(base + at);
+            unsigned long long segmentSize = at + sizeof(*segmentHeader) <= header->end
+                ? fuzzy_internal::fuzzy_segment_size(segmentHeader->count, segmentHeader->bytes) : 0;
+            if (segmentSize == 0 || segmentSize > header->end - at) {
+                fuzzy_index_close(mapped);
+                return false;
+            }
+
+            fuzzy_mapped_index::segment segment;
+            segment.offsets = (const uint32_t *)(segmentHeader + 1);
+            segment.presence = segment.offsets + segmentHeader->count + 1;
+            segment.lower = (const char *)(segment.presence + segmentHeader->count);
+            segment.boundary = (const uint8_t *)segment.lower + segmentHeader->bytes;
+            segment.first = mapped.count;
+            segment.count = (int)segmentHeader->count;
+
+            // Candidates must tile [0, bytes) in order, or a corrupt offset would read outside the segment
+            bool valid = segmentHeader->count <= (uint32_t)((std::numeric_limits<int>::max)() - mapped.count)
+                && segment.offsets[0] == 0 && segment.offsets[segmentHeader->count] == segmentHeader->bytes;
+            for (uint32_t i = 0; valid && i < segmentHeader->count; ++i)
+                valid = segment.offsets[i] <= segment.offsets[i + 1];
+            if (!valid) {
+                fuzzy_index_close(mapped);
+                return false;
+            }
+
+            mapped.segments.push_back(segment);
+            mapped.count += segment.count;
+            at += (size_t)segmentSize;
+        }
+
+        if ((uint32_t)mapped.count != header->count) {
+            fuzzy_index_close(mapped);
+            return false;
+        }
+        return true;
+    }
+
+    static void fuzzy_index_close(fuzzy_mapped_index & mapped) {
+        if (mapped.view) {
+#ifdef _WIN32
+            UnmapViewOfFile(mapped.view);
+#else
+            munmap(const_cast<void *>(mapped.view), mapped.size);
+#endif
+        }
+        mapped.segments.clear();
+        mapped.count = 0;
+        mapped.view = nullptr;
+        mapped.size = 0;
+    }
+
+    static int fuzzy_index_size(const fuzzy_mapped_index & mapped) {
+        return mapped.count;
+    }
+
+    template <typename Scoring> static bool fuzzy_match(const fuzzy_mapped_index & mapped, int candidate, char const * pattern, int & outScore) {
+        fuzzy_internal::fuzzy_pattern folded;
+        if (candidate < 0 || candidate >= mapped.count || !fuzzy_internal::fuzzy_pattern_init(folded, pattern))
+            return false;
+
+        uint32_t presence = 0;
+        for (int i = 0; i < folded.len; ++i)
+            presence |= fuzzy_internal::fuzzy_presence(folded.lower[i]);
+
+        // Last segment starting at or before candidate
+        auto it = std::upper_bound(mapped.segments.begin(), mapped.segments.end(), candidate,
+            [](int value, const fuzzy_mapped_index::segment & segment) { return value < segment.first; });
+        const fuzzy_mapped_index::segment & segment = *(it - 1);
+        int local = candidate - segment.first;
+
+        uint32_t start = segment.offsets[local];
+        return fuzzy_internal::fuzzy_match_candidate<Scoring>(folded, presence, segment.presence[local], segment.lower + start,
+            segment.boundary + start, (int)(segment.offsets[local + 1] - start), outScore);
+    }
+
+    // Same results as fuzzy_search over the fuzzy_index the file was written from
+    template <typename Scoring> static int fuzzy_search(const fuzzy_mapped_index & mapped, char const * pattern, fuzzy_result * results, int maxResults) {
+        fuzzy_internal::fuzzy_pattern folded;
+        if (maxResults <= 0 || !fuzzy_internal::fuzzy_pattern_init(folded, pattern))
+            return 0;
+
+        uint32_t presence = 0;
+        for (int i = 0; i < folded.len; ++i)
+            presence |= fuzzy_internal::fuzzy_presence(folded.lower[i]);
+
+        int resultCount = 0;
+        for (const fuzzy_mapped_index::segment & segment : mapped.segments) {
+            for (int i = 0; i < segment.count; ++i) {
+                uint32_t start = segment.offsets[i];
+                fuzzy_result result = { segment.first + i, 0 };
+                int minScore = fuzzy_internal::fuzzy_min_score(results, resultCount, maxResults, result.index);
+                if (fuzzy_internal::fuzzy_match_candidate<Scoring>(folded, presence, segment.presence[i], segment.lower + start,
+                        segment.boundary + start, (int)(segment.offsets[i + 1] - start), result.score, minScore))
+                    fuzzy_internal::fuzzy_push_result(results, resultCount, maxResults, result);
+            }
+        }
+
+        std::sort_heap(results, results + resultCount, fuzzy_internal::fuzzy_result_better);
+        return resultCount;
+    }
 
-            // Initialize score
-            outScore = 100;
+    // Private implementation
+    // Same result as ::tolower in the "C" locale without the locale lookup or a branch
+    static char fuzzy_internal::fuzzy_lower(char c) {
+        return (char)(c | (((unsigned char)(c - 'A') < 26) << 5));
+    }
+
+    // True if no byte has its high bit set
+    static bool fuzzy_internal::fuzzy_is_ascii(const char * str, int len) {
+        int j = 0;
+#ifdef FTS_FUZZY_MATCH_SSE2
+        __m128i bits = _mm_setzero_si128();
+        for (; j + 16 <= len; j += 16)
+            bits = _mm_or_si128(bits, _mm_loadu_si128((const __m128i *)(str + j)));
+        if (_mm_movemask_epi8(bits) != 0)
+            return false;
+#endif
+        unsigned char tail = 0;
+        for (; j < len; ++j)
+            tail |= (unsigned char)str[j];
+        return tail < 0x80;
+    }
 
-            // Apply leading letter penalty
-            int penalty = leading_letter_penalty * matches[0];
-            if (penalty < max_leading_letter_penalty)
-                penalty = max_leading_letter_penalty;
-            outScore += penalty;
+    // Decodes the code point at the start of str and returns its length in bytes
+    static int fuzzy_internal::fuzzy_decode(const char * str, int len, uint32_t & codepoint) {
+        const unsigned char * bytes = (const unsigned char *)str;
+        unsigned char lead = bytes[0];
+        int size = lead < 0x80 ? 1
+            : (lead >= 0xC2 && lead <= 0xDF) ? 2
+            : (lead >= 0xE0 && lead <= 0xEF) ? 3
+            : (lead >= 0xF0 && lead <= 0xF4) ? 4
+            : 0;
 
-            // Apply unmatched penalty
-            int unmatched = (int)(str - strBegin) - nextMatch;
-            outScore += unmatched_letter_penalty * unmatched;
+        if (size == 1) {
+            codepoint = lead;
+            return 1;
+        }
+        if (size == 0 || size > len) {
+            codepoint = invalid_code_point + lead;
+            return 1;
+        }
 
-            // Apply ordering bonuses
-            for (int i = 0; i < nextMatch; ++i) {
-                uint8_t currIdx = matches[i];
+        codepoint = lead & (0x7F >> size);
+        for (int k = 1; k < size; ++k) {
+            if ((bytes[k] & 0xC0) != 0x80) {
+                codepoint = invalid_code_point + lead;
+                return 1;
+            }
+            codepoint = (codepoint << 6) | (bytes[k] & 0x3F);
+        }
+        return size;
+    }
 
-                if (i > 0) {
-                    uint8_t prevIdx = matches[i - 1];
+    static uint32_t fuzzy_internal::fuzzy_fold(uint32_t codepoint) {
+        if (codepoint < 0x80)
+            return (unsigned char)fuzzy_lower((char)codepoint);
 
-                    // Sequential
-                    if (currIdx == (prevIdx + 1))
-                        outScore += sequential_bonus;
+        // Ranges are sorted, so stop at the first one past the code point
+        for (const fuzzy_fold_range & range : fold_ranges) {
+            if (codepoint < range.first)
+                break;
+            if (codepoint <= range.last && (codepoint - range.first) % range.stride == 0)
+                return codepoint + range.delta;
+        }
+        return codepoint;
+    }
+
+    // True for the lowercase letters the fold table maps to
+    static bool fuzzy_internal::fuzzy_is_lower(uint32_t codepoint) {
+        if (codepoint < 0x80)
+            return codepoint - 'a' < 26;
+
+        for (const fuzzy_fold_range & range : fold_ranges) {
+            uint32_t first = range.first + range.delta;
+            if (codepoint >= first && codepoint <= (uint32_t)(range.last + range.delta) && (codepoint - first) % range.stride == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Folds the code point at the start of str into lower, which receives the same number of bytes. Returns that number.
+    static int fuzzy_internal::fuzzy_fold_next(const char * str, int len, char * lower, uint32_t & codepoint, uint32_t & folded) {
+        int size = fuzzy_decode(str, len, codepoint);
+        folded = fuzzy_fold(codepoint);
+        if (folded == codepoint) {
+            memcpy(lower, str, size);
+            return size;
+        }
+
+        static const unsigned char lead[] = { 0, 0, 0xC0, 0xE0, 0xF0 };
+        uint32_t bits = folded;
+        if (size == 1) {
+            lower[0] = (char)bits;
+            return 1;
+        }
+        for (int k = size - 1; k > 0; --k) {
+            lower[k] = (char)(0x80 | (bits & 0x3F));
+            bits >>= 6;
+        }
+        lower[0] = (char)(lead[size] | bits);
+        return size;
+    }
+
+    // Splits folded bytes into code points, each carrying the flags and offset of its lead byte. Returns the count.
+    static int fuzzy_internal::fuzzy_units(const char * lower, const uint8_t * boundary, int len, uint32_t * units, uint8_t * unitBoundary, int * offsets) {
+        int count = 0;
+        for (int j = 0; j < len; ++count) {
+            unitBoundary[count] = boundary[j];
+            offsets[count] = j;
+            if ((unsigned char)lower[j] < 0x80)
+                units[count] = (unsigned char)lower[j++];
+            else
+                j += fuzzy_decode(lower + j, len - j, units[count]);
+        }
+        return count;
+    }
+
+    // Character handed to Scoring::is_separator. Separators are ASCII, so other code points never are.
+    static char fuzzy_internal::fuzzy_ascii(char c) {
+        return c;
+    }
+
+    static char fuzzy_internal::fuzzy_ascii(uint32_t codepoint) {
+        return codepoint < 0x80 ? (char)codepoint : '\0';
+    }
+
+    static bool fuzzy_internal::fuzzy_pattern_init(fuzzy_pattern & out, const char * pattern) {
+        size_t len = strlen(pattern);
+        if (len > (size_t)max_str_len)
+            return false;
+
+        out.len = (int)len;
+        out.unitLen = 0;
+        out.ascii = fuzzy_is_ascii(pattern, out.len);
+        if (out.ascii) {
+            for (int i = 0; i < out.len; ++i) {
+                char c = fuzzy_lower(pattern[i]);
+                out.lower[i] = c;
+                out.upper[i] = (c >= 'a' && c <= 'z') ? (char)(c - ('a' - 'A')) : c;
+                out.units[i] = (unsigned char)c;
+            }
+            out.unitLen = out.len;
+            return true;
+        }
+
+        for (int i = 0; i < out.len; ) {
+            uint32_t codepoint;
+            int size = fuzzy_fold_next(pattern + i, out.len - i, out.lower + i, codepoint, out.units[out.unitLen++]);
+            for (int k = i; k < i + size; ++k) {
+                char c = out.lower[k];
+                out.upper[k] = (c >= 'a' && c <= 'z') ? (char)(c - ('a' - 'A')) : c;
+            }
+            i += size;
+        }
+        return true;
+    }
+
+    static bool fuzzy_internal::fuzzy_subsequence_scalar(const fuzzy_pattern & pattern, int i, const char * str, int j, int strLen) {
+        for (; j < strLen && i < pattern.len; ++j) {
+            if (str[j] == pattern.lower[i] || str[j] == pattern.upper[i])
+                ++i;
+        }
+        return i == pattern.len;
+    }
+
+#ifdef FTS_FUZZY_MATCH_SSE2
+    static int fuzzy_internal::fuzzy_ctz(unsigned int mask) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (int)index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    // Finds each pattern character 16 bytes at a time, only the tail shorter than a block is scanned per byte
+    static bool fuzzy_internal::fuzzy_subsequence_sse2(const fuzzy_pattern & pattern, int i, const char * str, int j, int strLen) {
+        for (; i < pattern.len; ++i) {
+            const __m128i lower = _mm_set1_epi8(pattern.lower[i]);
+            const __m128i upper = _mm_set1_epi8(pattern.upper[i]);
+
+            for (;;) {
+                if (j + 16 > strLen)
+                    return fuzzy_subsequence_scalar(pattern, i, str, j, strLen);
+
+                __m128i block = _mm_loadu_si128((const __m128i *)(str + j));
+                unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, lower), _mm_cmpeq_epi8(block, upper)));
+                if (mask) {
+                    j += fuzzy_ctz(mask) + 1;
+                    break;
                 }
+                j += 16;
+            }
+        }
+        return true;
+    }
+#endif
 
-                // Check for bonuses based on neighbor character value
-                if (currIdx > 0) {
-                    // Camel case
-                    char neighbor = strBegin[currIdx - 1];
-                    char curr = strBegin[currIdx];
-                    if (::islower(neighbor) && ::isupper(curr))
-                        outScore += camel_bonus;
-
-                    // Separator
-                    bool neighborSeparator = neighbor == '_' || neighbor == ' ';
-                    if (neighborSeparator)
-                        outScore += separator_bonus;
+#ifdef FTS_FUZZY_MATCH_AVX2
+    static bool fuzzy_internal::fuzzy_has_avx2() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+
+        // AVX and OSXSAVE, then check that the OS saves YMM state
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+            return false;
+        if ((_xgetbv(0) & 6) != 6)
+            return false;
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    FTS_FUZZY_MATCH_TARGET_AVX2 static bool fuzzy_internal::fuzzy_subsequence_avx2(const fuzzy_pattern & pattern, int i, const char * str, int j, int strLen) {
+        for (; i < pattern.len; ++i) {
+            const __m256i lower = _mm256_set1_epi8(pattern.lower[i]);
+            const __m256i upper = _mm256_set1_epi8(pattern.upper[i]);
+
+            for (;;) {
+                if (j + 32 > strLen) {
+                    // Leave the upper halves clean before running legacy SSE code
+                    _mm256_zeroupper();
+                    return fuzzy_subsequence_sse2(pattern, i, str, j, strLen);
                 }
-                else {
-                    // First letter
-                    outScore += first_letter_bonus;
+
+                __m256i block = _mm256_loadu_si256((const __m256i *)(str + j));
+                unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, lower), _mm256_cmpeq_epi8(block, upper)));
+                if (mask) {
+                    j += fuzzy_ctz(mask) + 1;
+                    break;
                 }
+                j += 32;
             }
         }
+        return true;
+    }
+#endif
 
-        // Return best result
-        if (recursiveMatch && (!matched || bestRecursiveScore > outScore)) {
-            // Recursive score is better than "this"
-            memcpy(matches, bestRecursiveMatches, maxMatches);
-            outScore = bestRecursiveScore;
-            return true;
+    // Picks the widest implementation the CPU supports, decided once per process
+    static fuzzy_internal::fuzzy_subsequence_fn fuzzy_internal::fuzzy_subsequence() {
+#if defined(FTS_FUZZY_MATCH_AVX2)
+        static const fuzzy_subsequence_fn best = fuzzy_has_avx2() ? fuzzy_subsequence_avx2 : fuzzy_subsequence_sse2;
+        return best;
+#elif defined(FTS_FUZZY_MATCH_SSE2)
+        return fuzzy_subsequence_sse2;
+#else
+        return fuzzy_subsequence_scalar;
+#endif
+    }
+
+    // Turns ascending match positions into ranges covering each matched code point, merging those that touch.
+    // Returns the range count, or -1 if they do not fit in maxRanges.
+    static int fuzzy_internal::fuzzy_coalesce(const char * str, int strLen, const int * positions, int count, fuzzy_range * ranges, int maxRanges) {
+        int rangeCount = 0;
+        for (int i = 0; i < count; ++i) {
+            int begin = positions[i];
+            int end = begin + 1;
+            if ((unsigned char)str[begin] >= 0x80) {
+                uint32_t codepoint;
+                end = begin + fuzzy_decode(str + begin, strLen - begin, codepoint);
+            }
+
+            if (rangeCount > 0 && ranges[rangeCount - 1].end == begin) {
+                ranges[rangeCount - 1].end = end;
+                continue;
+            }
+            if (rangeCount == maxRanges)
+                return -1;
+            ranges[rangeCount++] = { begin, end };
         }
-        else if (matched) {
-            // "this" score is better than recursive
-            return true;
+        return rangeCount;
+    }
+
+    // Splits pattern on spaces. Fails if there is no term, more than max_terms, or a term is too long.
+    static bool fuzzy_internal::fuzzy_terms_init(fuzzy_terms & out, const char * pattern) {
+        out.count = 0;
+        out.presence = 0;
+        char term[max_str_len + 1];
+        while (*pattern != '\0') {
+            while (*pattern == ' ')
+                ++pattern;
+
+            size_t len = 0;
+            while (pattern[len] != '\0' && pattern[len] != ' ')
+                ++len;
+            if (len == 0)
+                break;
+            if (len > (size_t)max_str_len || out.count == max_terms)
+                return false;
+
+            memcpy(term, pattern, len);
+            term[len] = '\0';
+            fuzzy_pattern & folded = out.terms[out.count++];
+            fuzzy_pattern_init(folded, term);
+            for (int i = 0; i < folded.len; ++i)
+                out.presence |= fuzzy_presence(folded.lower[i]);
+            pattern += len;
         }
-        else {
-            // no match
+        return out.count > 0;
+    }
+
+    // Scores every term on one prepared candidate, stopping at the first that does not match
+    template <typename Scoring> static bool fuzzy_internal::fuzzy_score_terms(const fuzzy_terms & terms, const char * lower, const uint8_t * boundary, int strLen, int & outScore) {
+        for (int t = 0; t < terms.count; ++t) {
+            if (!fuzzy_subsequence()(terms.terms[t], 0, lower, 0, strLen))
+                return false;
+        }
+
+        int total = 0;
+        for (int t = 0; t < terms.count; ++t) {
+            int score;
+            if (!fuzzy_score_prepared<Scoring>(terms.terms[t], lower, boundary, strLen, score, nullptr, max_str_len))
+                return false;
+            total += score;
+        }
+        outScore = total;
+        return true;
+    }
+
+    // Code point by code point check for patterns with non-ASCII characters, whose case variants differ in more than one byte
+    static bool fuzzy_internal::fuzzy_subsequence_utf8(const fuzzy_pattern & pattern, const char * str, int strLen) {
+        int i = 0;
+        for (int j = 0; j < strLen && i < pattern.unitLen; ) {
+            uint32_t codepoint;
+            j += fuzzy_decode(str + j, strLen - j, codepoint);
+            if (fuzzy_fold(codepoint) == pattern.units[i])
+                ++i;
+        }
+        return i == pattern.unitLen;
+    }
+
+    // Rejects raw candidates that cannot match. ASCII patterns use the vectorized byte scan: bytes of multi-byte UTF-8
+    // sequences never equal an ASCII byte, and no non-ASCII code point folds to one.
+    static bool fuzzy_internal::fuzzy_prefilter(const fuzzy_pattern & pattern, const char * str, int strLen) {
+        if (pattern.ascii)
+            return fuzzy_subsequence()(pattern, 0, str, 0, strLen);
+        return fuzzy_subsequence_utf8(pattern, str, strLen);
+    }
+
+    // Bonus for matching position j
+    template <typename Scoring, typename Unit> static int fuzzy_internal::fuzzy_bonus(const Unit * lower, const uint8_t * boundary, int j) {
+        int bonus = 0;
+        if (boundary[j] & boundary_first)
+            bonus += Scoring::first_letter_bonus;
+        if (boundary[j] & boundary_camel)
+            bonus += Scoring::camel_bonus;
+        if (j > 0 && Scoring::is_separator(fuzzy_ascii(lower[j - 1])))
+            bonus += Scoring::separator_bonus;
+        return bonus;
+    }
+
+    // Letters get a bit each, digits share the remaining six. Other characters are not tracked.
+    static uint32_t fuzzy_internal::fuzzy_presence(char lower) {
+        if (lower >= 'a' && lower <= 'z')
+            return 1u << (lower - 'a');
+        if (lower >= '0' && lower <= '9')
+            return 1u << (26 + (lower - '0') % 6);
+        return 0;
+    }
+
+    // Lowercases str and flags first letter and camel case positions. ASCII strings take a branch-free loop; otherwise
+    // each code point is folded in place and its flags go on its lead byte.
+    static void fuzzy_internal::fuzzy_prepare(const char * str, int len, char * lower, uint8_t * boundary) {
+        if (len == 0)
+            return;
+
+        if (fuzzy_is_ascii(str, len)) {
+            for (int j = 0; j < len; ++j)
+                lower[j] = fuzzy_lower(str[j]);
+
+            // Camel case: lowercase neighbor followed by an uppercase letter
+            boundary[0] = boundary_first;
+            for (int j = 1; j < len; ++j)
+                boundary[j] = (uint8_t)(((unsigned char)(str[j - 1] - 'a') < 26 && (unsigned char)(str[j] - 'A') < 26) * boundary_camel);
+            return;
+        }
+
+        bool neighborLower = false;
+        for (int j = 0; j < len; ) {
+            char c = str[j];
+            if ((unsigned char)c < 0x80) {
+                lower[j] = fuzzy_lower(c);
+                boundary[j] = (uint8_t)((j == 0 ? boundary_first : 0) | ((neighborLower && (unsigned char)(c - 'A') < 26) * boundary_camel));
+                neighborLower = (unsigned char)(c - 'a') < 26;
+                ++j;
+                continue;
+            }
+
+            uint32_t codepoint;
+            uint32_t folded;
+            int size = fuzzy_fold_next(str + j, len - j, lower + j, codepoint, folded);
+
+            boundary[j] = j == 0 ? boundary_first : 0;
+            if (neighborLower && folded != codepoint)
+                boundary[j] |= boundary_camel;
+            for (int k = 1; k < size; ++k)
+                boundary[j + k] = 0;
+
+            neighborLower = fuzzy_is_lower(codepoint);
+            j += size;
+        }
+    }
+
+    // Finds the earliest (lo) and latest (hi) position each pattern character can occupy in a full match.
+    // Returns false if pattern is not a subsequence of str.
+    template <typename Unit> static bool fuzzy_internal::fuzzy_bounds(const Unit * pattern, int patternLen, const Unit * lower, int strLen, int * lo, int * hi) {
+        int i = 0;
+        for (int j = 0; j < strLen && i < patternLen; ++j) {
+            if (lower[j] == pattern[i])
+                lo[i++] = j;
+        }
+        if (i < patternLen)
+            return false;
+
+        i = patternLen - 1;
+        for (int j = strLen - 1; j >= 0 && i >= 0; --j) {
+            if (lower[j] == pattern[i])
+                hi[i--] = j;
+        }
+        return true;
+    }
+
+    // Most a word boundary can add. A camel hump follows a lowercase letter and a separator follows a separator, so only
+    // one applies unless the profile treats lowercase letters (or the stand-in for non-ASCII ones) as separators.
+    template <typename Scoring> static constexpr int fuzzy_internal::fuzzy_max_boundary_bonus() {
+        int camel = Scoring::camel_bonus > 0 ? Scoring::camel_bonus : 0;
+        int separator = Scoring::separator_bonus > 0 ? Scoring::separator_bonus : 0;
+        bool exclusive = !Scoring::is_separator('\0');
+        for (char c = 'a'; c <= 'z'; ++c)
+            exclusive = exclusive && !Scoring::is_separator(c);
+        return exclusive ? (camel > separator ? camel : separator) : camel + separator;
+    }
+
+    // Most that any character after the first can add to a score: adjacent to the previous match and on a word boundary
+    template <typename Scoring> static constexpr int fuzzy_internal::fuzzy_max_bonus() {
+        return (Scoring::sequential_bonus > 0 ? Scoring::sequential_bonus : 0) + fuzzy_max_boundary_bonus<Scoring>();
+    }
+
+    // Most the first character can score when matched at or after position first
+    template <typename Scoring> static int fuzzy_internal::fuzzy_first_max(int first) {
+        int penalty = Scoring::leading_letter_penalty * first;
+        if (penalty < Scoring::max_leading_letter_penalty)
+            penalty = Scoring::max_leading_letter_penalty;
+        return penalty + (first == 0 && Scoring::first_letter_bonus > 0 ? Scoring::first_letter_bonus : 0) + fuzzy_max_boundary_bonus<Scoring>();
+    }
+
+    // Fills row with the best partial score of pattern[0, rowCount) whose last character is matched at each position of str.
+    // Only [lo[rowCount - 1], hi[rowCount - 1]] of row is meaningful. Only two rows are live at a time; scratch must hold strLen ints.
+    // Returns false, leaving row undefined, as soon as no row entry plus the best bonuses of the remaining rows reaches floor.
+    template <typename Scoring, typename Unit> static bool fuzzy_internal::fuzzy_score_rows(const Unit * pattern, int rowCount, const Unit * lower, const uint8_t * boundary,
+        const int * lo, const int * hi, int * row, int * scratch, int floor)
+    {
+        // Alternate buffers so that the last row lands in "row"
+        int * curr = (rowCount & 1) ? row : scratch;
+        int * prev = (rowCount & 1) ? scratch : row;
+
+        int rowBest = no_match;
+        for (int j = lo[0]; j <= hi[0]; ++j) {
+            int penalty = Scoring::leading_letter_penalty * j;
+            if (penalty < Scoring::max_leading_letter_penalty)
+                penalty = Scoring::max_leading_letter_penalty;
+            curr[j] = lower[j] == pattern[0] ? fuzzy_bonus<Scoring, Unit>(lower, boundary, j) + penalty : no_match;
+            if (curr[j] > rowBest)
+                rowBest = curr[j];
+        }
+
+        for (int i = 1; i < rowCount; ++i) {
+            if (rowBest + (rowCount - i) * fuzzy_max_bonus<Scoring>() < floor)
+                return false;
+
+            int * swap = prev; prev = curr; curr = swap;
+
+            rowBest = no_match;
+            int prefixBest = no_match;
+            int k = lo[i - 1];
+            for (int j = lo[i]; j <= hi[i]; ++j) {
+                // Best non-adjacent predecessor in [lo[i - 1], j - 2]
+                for (; k <= j - 2 && k <= hi[i - 1]; ++k) {
+                    if (prev[k] > prefixBest)
+                        prefixBest = prev[k];
+                }
+
+                curr[j] = no_match;
+                if (lower[j] != pattern[i])
+                    continue;
+
+                int best = prefixBest;
+                if (j - 1 <= hi[i - 1] && prev[j - 1] != no_match && prev[j - 1] + Scoring::sequential_bonus > best)
+                    best = prev[j - 1] + Scoring::sequential_bonus;
+                if (best != no_match) {
+                    curr[j] = best + fuzzy_bonus<Scoring, Unit>(lower, boundary, j);
+                    if (curr[j] > rowBest)
+                        rowBest = curr[j];
+                }
+            }
+        }
+        return rowBest >= floor;
+    }
+
+    template <typename Scoring> static bool fuzzy_internal::fuzzy_match_dp(const fuzzy_pattern & folded, const char * str, int & outScore, int * matches, int maxMatches,
+        int minScore)
+    {
+        // Cheap vectorized rejection before any per-position work
+        size_t rawLen = strlen(str);
+        if (folded.len == 0 || rawLen > (size_t)(std::numeric_limits<int>::max)() || !fuzzy_prefilter(folded, str, (int)rawLen))
             return false;
+
+        // Short strings stay on the stack, longer ones use the thread's arena
+        char lowerStack[max_str_len];
+        uint8_t boundaryStack[max_str_len];
+        char * lower = lowerStack;
+        uint8_t * boundary = boundaryStack;
+        if (rawLen > (size_t)max_str_len) {
+            lower = fuzzy_arena<char, 0>(rawLen);
+            boundary = fuzzy_arena<uint8_t, 0>(rawLen);
+        }
+
+        fuzzy_prepare(str, (int)rawLen, lower, boundary);
+        return fuzzy_score_prepared<Scoring>(folded, lower, boundary, (int)rawLen, outScore, matches, maxMatches, minScore);
+    }
+
+    // Scratch for candidates longer than max_str_len, one per element type and slot so buffers in use together never alias.
+    // Each grows to the longest candidate seen on its thread and is then reused.
+    template <typename T, int Slot> static T * fuzzy_internal::fuzzy_arena(size_t count) {
+        static thread_local std::vector<T> arena;
+        if (arena.size() < count)
+            arena.resize(count);
+        return arena.data();
+    }
+
+    template <typename Scoring> static bool fuzzy_internal::fuzzy_match_indexed(const fuzzy_index & index, int candidate, const fuzzy_pattern & folded, uint32_t presence, int & outScore,
+        int minScore, fuzzy_search_stats * stats)
+    {
+        uint32_t start = index.offsets[candidate];
+        return fuzzy_match_candidate<Scoring>(folded, presence, index.presence[candidate], index.lower.data() + start,
+            index.boundary.data() + start, (int)(index.offsets[candidate + 1] - start), outScore, minScore, stats);
+    }
+
+    // Scores one prepared candidate, wherever its arrays live
+    template <typename Scoring> static bool fuzzy_internal::fuzzy_match_candidate(const fuzzy_pattern & folded, uint32_t presence, uint32_t candidatePresence,
+        const char * lower, const uint8_t * boundary, int strLen, int & outScore, int minScore, fuzzy_search_stats * stats)
+    {
+        if (stats)
+            ++stats->candidates;
+
+        // Both sides are already folded, so the byte scan is a valid rejection for non-ASCII patterns too
+        if ((candidatePresence & presence) != presence || folded.len == 0 || !fuzzy_subsequence()(folded, 0, lower, 0, strLen)) {
+            if (stats)
+                ++stats->filtered;
+            return false;
+        }
+
+        return fuzzy_score_prepared<Scoring>(folded, lower, boundary, strLen, outScore, nullptr, max_str_len, minScore, stats);
+    }
+
+    // Bytes taken by a segment, header and padding included
+    static unsigned long long fuzzy_internal::fuzzy_segment_size(uint32_t count, uint32_t bytes) {
+        unsigned long long size = sizeof(fuzzy_segment_header) + ((unsigned long long)count * 2 + 1) * sizeof(uint32_t) + (unsigned long long)bytes * 2;
+        return (size + 3) & ~3ull;
+    }
+
+    // Scores an already lowercased and flagged candidate. ASCII candidates are scored byte by byte; others are split into
+    // code points first and their match positions mapped back to byte offsets.
+    template <typename Scoring> static bool fuzzy_internal::fuzzy_score_prepared(const fuzzy_pattern & folded, const char * lower, const uint8_t * boundary, int strLen,
+        int & outScore, int * matches, int maxMatches, int minScore, fuzzy_search_stats * stats)
+    {
+        if (folded.len == 0 || folded.unitLen > maxMatches)
+            return false;
+
+        if (folded.ascii && fuzzy_is_ascii(lower, strLen))
+            return fuzzy_score_units<Scoring>(folded.lower, folded.len, lower, boundary, strLen, outScore, matches, minScore, stats);
+
+        uint32_t unitsStack[max_str_len];
+        uint8_t unitBoundaryStack[max_str_len];
+        int offsetsStack[max_str_len];
+        uint32_t * units = unitsStack;
+        uint8_t * unitBoundary = unitBoundaryStack;
+        int * offsets = offsetsStack;
+        if (strLen > max_str_len) {
+            units = fuzzy_arena<uint32_t, 0>(strLen);
+            unitBoundary = fuzzy_arena<uint8_t, 1>(strLen);
+            offsets = fuzzy_arena<int, 1>(strLen);
+        }
+
+        int unitLen = fuzzy_units(lower, boundary, strLen, units, unitBoundary, offsets);
+        if (!fuzzy_score_units<Scoring>(folded.units, folded.unitLen, units, unitBoundary, unitLen, outScore, matches, minScore, stats))
+            return false;
+
+        if (matches) {
+            for (int i = 0; i < folded.unitLen; ++i)
+                matches[i] = offsets[matches[i]];
+        }
+        return true;
+    }
+
+    // Best match of pattern in lower, both already folded into one Unit per character.
+    // Gives up, returning false, once the match provably cannot score minScore.
+    template <typename Scoring, typename Unit> static bool fuzzy_internal::fuzzy_score_units(const Unit * pattern, int patternLen, const Unit * lower, const uint8_t * boundary,
+        int strLen, int & outScore, int * matches, int minScore, fuzzy_search_stats * stats)
+    {
+        if (strLen < patternLen)
+            return false;
+
+        // What the DP rows must reach. The length alone can rule a candidate out before it is scanned, and the earliest
+        // position of the first character tightens that once it is known.
+        int floor = minScore - 100 - Scoring::unmatched_letter_penalty * (strLen - patternLen);
+        bool bounded = minScore != no_match;
+        if (bounded && fuzzy_first_max<Scoring>(0) + (patternLen - 1) * fuzzy_max_bonus<Scoring>() < floor) {
+            if (stats)
+                ++stats->pruned;
+            return false;
+        }
+
+        int lo[max_str_len];
+        int hi[max_str_len];
+        if (!fuzzy_bounds(pattern, patternLen, lower, strLen, lo, hi))
+            return false;
+
+        if (bounded && fuzzy_first_max<Scoring>(lo[0]) + (patternLen - 1) * fuzzy_max_bonus<Scoring>() < floor) {
+            if (stats)
+                ++stats->pruned;
+            return false;
+        }
+
+        int rowStack[max_str_len];
+        int scratchStack[max_str_len];
+        int * row = rowStack;
+        int * scratch = scratchStack;
+        if (strLen > max_str_len) {
+            row = fuzzy_arena<int, 0>((size_t)strLen * 2);
+            scratch = row + strLen;
+        }
+
+        if (!fuzzy_score_rows<Scoring, Unit>(pattern, patternLen, lower, boundary, lo, hi, row, scratch, bounded ? floor : no_match)) {
+            if (stats)
+                ++stats->pruned;
+            return false;
+        }
+        if (stats)
+            ++stats->scored;
+
+        int last = -1;
+        for (int j = lo[patternLen - 1]; j <= hi[patternLen - 1]; ++j) {
+            if (row[j] != no_match && (last < 0 || row[j] > row[last]))
+                last = j;
+        }
+
+        outScore = 100 + row[last] + Scoring::unmatched_letter_penalty * (strLen - patternLen);
+
+        // Walk back through recomputed rows to recover the positions that produced the best score
+        if (matches) {
+            matches[patternLen - 1] = last;
+            for (int i = patternLen - 1; i > 0; --i) {
+                fuzzy_score_rows<Scoring, Unit>(pattern, i, lower, boundary, lo, hi, row, scratch, no_match);
+
+                int best = -1;
+                int end = last - 2 < hi[i - 1] ? last - 2 : hi[i - 1];
+                for (int k = lo[i - 1]; k <= end; ++k) {
+                    if (row[k] != no_match && (best < 0 || row[k] > row[best]))
+                        best = k;
+                }
+                if (last - 1 <= hi[i - 1] && row[last - 1] != no_match && (best < 0 || row[last - 1] + Scoring::sequential_bonus >= row[best]))
+                    best = last - 1;
+
+                last = best;
+                matches[i - 1] = last;
+            }
+        }
+
+        return true;
+    }
+
+    static bool fuzzy_internal::fuzzy_result_better(const fuzzy_result & a, const fuzzy_result & b) {
+        return a.score != b.score ? a.score > b.score : a.index < b.index;
+    }
+
+    // Bounded heap with the worst kept result on top, so a candidate only costs a comparison once the heap is full
+    static void fuzzy_internal::fuzzy_push_result(fuzzy_result * results, int & resultCount, int maxResults, fuzzy_result result) {
+        if (resultCount < maxResults) {
+            results[resultCount++] = result;
+            std::push_heap(results, results + resultCount, fuzzy_result_better);
+        }
+        else if (fuzzy_result_better(result, results[0])) {
+            std::pop_heap(results, results + resultCount, fuzzy_result_better);
+            results[resultCount - 1] = result;
+            std::push_heap(results, results + resultCount, fuzzy_result_better);
+        }
+    }
+
+    // Lowest score that still gets candidate into a full heap, given that ties go to the lower index.
+    // no_match while the heap has room.
+    static int fuzzy_internal::fuzzy_min_score(const fuzzy_result * results, int resultCount, int maxResults, int candidate) {
+        if (resultCount < maxResults)
+            return no_match;
+        return candidate < results[0].index ? results[0].score : results[0].score + 1;
+    }
+
+    // Never destroyed: joining threads from static destructors can deadlock while a DLL unloads,
+    // and idle workers blocked on the condition variable are simply ended with the process.
+    static fuzzy_internal::fuzzy_pool & fuzzy_internal::fuzzy_thread_pool() {
+        static fuzzy_pool * pool = new fuzzy_pool;
+        return *pool;
+    }
+
+    static void fuzzy_internal::fuzzy_pool_thread(fuzzy_pool & pool, int worker, unsigned generation) {
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        for (;;) {
+            pool.wake.wait(lock, [&] { return pool.generation != generation; });
+            generation = pool.generation;
+            if (worker > pool.jobWorkers)
+                continue;
+
+            fuzzy_job_fn job = pool.job;
+            void * context = pool.context;
+            lock.unlock();
+            job(context, worker);
+            lock.lock();
+            if (--pool.pending == 0)
+                pool.done.notify_one();
+        }
+    }
+
+    // Caller must hold pool.busy. Runs job on up to workers threads including the caller and returns once all are done.
+    static void fuzzy_internal::fuzzy_pool_run(fuzzy_pool & pool, int workers, fuzzy_job_fn job, void * context) {
+        while ((int)pool.threads.size() < workers - 1) {
+            try {
+                pool.threads.emplace_back(fuzzy_pool_thread, std::ref(pool), (int)pool.threads.size() + 1, pool.generation);
+            }
+            catch (const std::system_error &) {
+                break;
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(pool.mutex);
+        pool.job = job;
+        pool.context = context;
+        pool.jobWorkers = (std::min)(workers - 1, (int)pool.threads.size());
+        pool.pending = pool.jobWorkers;
+        ++pool.generation;
+        lock.unlock();
+        pool.wake.notify_all();
+
+        job(context, 0);
+
+        lock.lock();
+        pool.done.wait(lock, [&] { return pool.pending == 0; });
+    }
+
+    // Takes the next shard of worker "self", or steals one from the other workers once its own range is drained.
+    // Returns -1 when every shard has been claimed.
+    static int fuzzy_internal::fuzzy_claim_shard(std::vector<fuzzy_shard_range> & ranges, int self) {
+        int workers = (int)ranges.size();
+        for (int offset = 0; offset < workers; ++offset) {
+            fuzzy_shard_range & range = ranges[(self + offset) % workers];
+            if (range.next.load(std::memory_order_relaxed) >= range.end)
+                continue;
+
+            int shard = range.next.fetch_add(1, std::memory_order_relaxed);
+            if (shard < range.end)
+                return shard;
         }
+        return -1;
     }
 } // namespace fts
 
@@ -5,8 +5,15 @@
 #include <fstream>
 #include <cstdio>
 #include <ctime>
+#include <chrono>
+#include <algorithm>
 #include <filesystem>
+#include <map>
+#include <vector>
+#include <string_view>
+#include <charconv>
 #include <winsock2.h>
+#include <bcrypt.h>
 #include <curl/curl.h>
 
 class Updater { 
@@ -14,18 +21,133 @@ public:
     std::ofstream logStream;
     std::string channel;
     std::string version;
+    std::string loadedVersion;
     bool shownDownloadError = false;
     bool shownDirectoryError = false;
     bool isLoaded = false;
+    bool checkedOnline = false;
 
+    /**
+     * Responses are meant to be reused across requests so their buffers are recycled,
+     * allocations counts buffer growth across every response of the run
+     */
     struct HttpResponse {
         std::string header;
         std::string content;
-        CURLcode curlCode;
-        long responseCode;
+        CURLcode curlCode = CURLE_OK;
+        long responseCode = 0;
+        inline static int allocations = 0;
+
+        void reserve(size_t size) {
+            if(size <= content.capacity()) return;
+            content.reserve(size);
+            allocations++;
+        }
+    };
+
+    struct ResourceFailure {
+        int failures;
+        time_t nextCheck;
+    };
+    std::map<std::string, ResourceFailure> failedResources;
+
+    struct ResourceEntry {
+        std::string name;
+        int priority;
+    };
+
+    /**
+     * Token bucket shared by all transfers, rates are in bytes per second
+     */
+    struct RateLimiter {
+        double rate = 0;
+        double maxRate = 0;
+        double minRate = 16 * 1024;
+        bool adaptive = false;
+        double tokens = 0;
+        std::map<std::string, double> baselineRtt;
+        curl_off_t transferred = 0;
+        std::chrono::steady_clock::time_point lastRefill = std::chrono::steady_clock::now();
+
+        void beginTransfer() {
+            transferred = 0;
+        }
+
+        void consume(curl_off_t now) {
+            if(rate <= 0) return;
+
+            auto time = std::chrono::steady_clock::now();
+            tokens += std::chrono::duration<double>(time - lastRefill).count() * rate;
+            tokens = (std::min)(tokens, rate / 4);
+            lastRefill = time;
+
+            tokens -= (double) (now - transferred);
+            transferred = now;
+
+            if(tokens < 0) Sleep((DWORD) (-tokens * 1000 / rate));
+        }
+
+        /**
+         * Connect RTT is compared per host, a LAN peer and the origin have nothing in common.
+         * It's taken before any data flows, so it only sees congestion from other traffic.
+         */
+        void sampleRtt(const std::string& host, double rtt) {
+            if(!adaptive || rate <= 0 || rtt <= 0) return;
+
+            auto& baseline = baselineRtt[host];
+            if(baseline <= 0 || rtt < baseline) baseline = rtt;
+            if(rtt > baseline * 2) rate = (std::max)(rate / 2, minRate);
+            else rate = (std::min)(rate + maxRate / 10, maxRate);
+        }
+
+        /**
+         * Congestion caused by the transfer itself shows up as throughput below the rate the bucket allowed,
+         * the link is the bottleneck then so the rate drops below it to leave headroom.
+         * Transfers shorter than about a second mostly run on the initial burst and say nothing.
+         */
+        void sampleThroughput(double speed, double size) {
+            if(!adaptive || rate <= 0 || speed <= 0 || size < rate) return;
+            if(speed < rate * 0.8) rate = (std::max)(speed * 0.8, minRate);
+        }
+    } rateLimiter;
+
+    /**
+     * Where update files are served from, configured per channel in transport.txt
+     */
+    enum class TransportKind {
+        Curl,
+        Directory,
+        Bundle
     };
 
+    struct Transport {
+        TransportKind kind = TransportKind::Curl;
+        std::string root;
+        std::string bundleData;
+        std::map<std::string, std::string_view, std::less<>> bundle;
+    } transport;
+
+    /**
+     * Optional content addressed cache shared between machines, files are stored under their SHA-256
+     */
+    struct PeerCache {
+        std::string root;
+        bool writable = false;
+        std::map<std::string, std::string> hashes;
+        int hits = 0;
+        int misses = 0;
+    } peerCache;
+
     const char* BIurlRoot = "https://geometrydash.eu/mods/betterinfo/v2/";
+    const time_t defaultCheckInterval = 600;
+    const time_t resourceRetryInterval = 3600;
+    const time_t maxResourceRetryInterval = 604800;
+    const int criticalResourcePriority = 0;
+    const int defaultResourcePriority = 100;
+    static constexpr size_t maxReserveHint = 64 * 1024 * 1024;
+    const size_t keptVersions = 3;
+    const time_t prefetchDelay = 120;
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
     /**
      * Error helper functions
@@ -51,6 +173,12 @@ public:
         shownDownloadError = true;
     }
 
+    void showBadVersionError() {
+        std::stringstream errorText;
+        errorText << "BetterInfo " << version << " failed to load before and there is no other version to fall back to.\n\nTo download and try it again, create an empty file called force_update.txt in the betterinfo/v2 folder.\n\nIf the problem persists, you might want to look at the instructions for manual installation.";
+        showCriticalError(errorText.str().c_str());
+    }
+
     /**
      * Path/URL helper functions
      */
@@ -77,40 +205,107 @@ public:
         return pathStream.str();
     }
 
+    /**
+     * Versions come from the server or a transport and become a directory name, so only plain names are accepted.
+     * Anything that could leave versions/ (".", "..", separators, drive letters) would be staged, and later removed, elsewhere.
+     */
+    static bool validVersion(const std::string& candidate) {
+        return !candidate.empty() && candidate != "." && candidate != ".." && candidate.find_first_of("/\\:") == std::string::npos;
+    }
+
+    /**
+     * Every version is staged in its own directory, current.txt decides which one is loaded
+     */
+    std::string stagingDirectory(const std::string& stagedVersion) {
+        std::stringstream pathStream;
+        pathStream << BIpath("versions");
+        tryCreateDirectory(pathStream.str());
+        pathStream << "/" << stagedVersion;
+        return pathStream.str();
+    }
+
+    std::string stagingPath(const std::string& stagedVersion, const std::string& file) {
+        std::stringstream pathStream;
+        pathStream << stagingDirectory(stagedVersion);
+        tryCreateDirectory(pathStream.str());
+        pathStream << "/" << file;
+        return pathStream.str();
+    }
+
     std::string resourcesPath(const std::string& file) {
         std::stringstream pathStream;
         pathStream << "Resources/" << file;
         return pathStream.str();
     }
 
-    std::string channelUrl(const std::string& file) {
-        std::stringstream urlStream;
-        urlStream << BIurlRoot << channel << "/" << file;
-        return urlStream.str();
+    /**
+     * Update files are named relative to the transport root
+     */
+    std::string channelFile(const std::string& file) {
+        std::stringstream fileStream;
+        fileStream << channel << "/" << file;
+        return fileStream.str();
     }
 
-    std::string versionUrl(const std::string& file) {
-        std::stringstream urlStream;
-        urlStream << BIurlRoot << version << "/" << file;
-        return urlStream.str();
+    std::string versionFile(const std::string& file) {
+        std::stringstream fileStream;
+        fileStream << version << "/" << file;
+        return fileStream.str();
     }
 
-    std::string versionResourcesUrl(const std::string& file) {
-        std::stringstream urlStream;
-        urlStream << "resources/" << file;
-        return versionUrl(urlStream.str());
+    std::string resourceFile(const std::string& file) {
+        std::stringstream fileStream;
+        fileStream << "resources/" << file;
+        return fileStream.str();
     }
 
     /**
      * String helper functions
      */
-    void trimString(std::string& string) {
-        string.erase(0, string.find_first_not_of('\n'));
-        string.erase(string.find_last_not_of('\n') + 1);
-        string.erase(0, string.find_first_not_of('\r'));
-        string.erase(string.find_last_not_of('\r') + 1);
-        string.erase(0, string.find_first_not_of(' '));
-        string.erase(string.find_last_not_of(' ') + 1);
+    static std::string_view trimView(std::string_view string) {
+        auto begin = string.find_first_not_of("\r\n\t ");
+        if(begin == std::string_view::npos) return string.substr(0, 0);
+        return string.substr(begin, string.find_last_not_of("\r\n\t ") - begin + 1);
+    }
+
+    /**
+     * curl is restricted to these protocols in sendWebRequest
+     */
+    static bool isHttpUrl(std::string_view url) {
+        return url.rfind("http://", 0) == 0 || url.rfind("https://", 0) == 0;
+    }
+
+    /**
+     * Turns a file:// URL into a path: file:///C:/x becomes C:/x, file://server/share becomes //server/share,
+     * and %XX escapes are decoded. Anything else is already a path and is returned unchanged.
+     */
+    static std::string fileUrlToPath(std::string_view url) {
+        constexpr std::string_view scheme = "file://";
+        if(url.size() < scheme.size() || !std::equal(scheme.begin(), scheme.end(), url.begin(), [](char a, char b) { return a == tolower((unsigned char) b); })) return std::string(url);
+        url.remove_prefix(scheme.size());
+
+        auto hostEnd = url.find('/');
+        auto host = url.substr(0, hostEnd);
+        auto path = hostEnd == std::string_view::npos ? std::string_view() : url.substr(hostEnd);
+
+        std::string decoded;
+        for(size_t i = 0; i < path.size(); i++) {
+            unsigned value;
+            if(path[i] == '%' && i + 2 < path.size() && std::from_chars(path.data() + i + 1, path.data() + i + 3, value, 16).ptr == path.data() + i + 3) {
+                decoded += (char) value;
+                i += 2;
+            } else decoded += path[i];
+        }
+
+        bool local = host.empty() || host == "localhost";
+        if(!local) return "//" + std::string(host) + decoded;
+        if(decoded.size() >= 3 && decoded[0] == '/' && isalpha((unsigned char) decoded[1]) && decoded[2] == ':') decoded.erase(0, 1);
+        return decoded;
+    }
+
+    std::string elapsedTime() {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+        return std::to_string(elapsed.count()) + " ms";
     }
 
     void log(std::string status) {
@@ -123,43 +318,107 @@ public:
     /**
      * CURL helper functions
      */
-    static size_t writeData(void *ptr, size_t size, size_t nmemb, std::string* data) {
-        data->append((char*) ptr, size * nmemb);
+    /**
+     * These run inside curl's C code, so no exception may escape them. Returning a short count aborts the transfer instead.
+     */
+    static size_t writeData(void *ptr, size_t size, size_t nmemb, HttpResponse* response) {
+        try {
+            auto& content = response->content;
+            if(content.size() + size * nmemb > content.capacity()) response->reserve((std::max)(content.size() + size * nmemb, content.capacity() * 2));
+            content.append((char*) ptr, size * nmemb);
+            return size * nmemb;
+        } catch (...) {
+            return 0;
+        }
+    }
+
+    static size_t readHeader(char *ptr, size_t size, size_t nmemb, HttpResponse* response) {
+        try {
+            std::string_view line(ptr, size * nmemb);
+            response->header.append(line);
+
+            constexpr std::string_view contentLength = "content-length:";
+            if(line.size() > contentLength.size() && std::equal(contentLength.begin(), contentLength.end(), line.begin(), [](char a, char b) { return a == tolower((unsigned char) b); })) {
+                auto value = trimView(line.substr(contentLength.size()));
+                size_t length = 0;
+                if(std::from_chars(value.data(), value.data() + value.size(), length).ec == std::errc() && length <= maxReserveHint) response->reserve(length);
+            }
+        } catch (...) {}
+
         return size * nmemb;
     }
 
-    HttpResponse sendWebRequest(const std::string& url) {
+    static int throttleTransfer(void* limiter, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+        ((RateLimiter*) limiter)->consume(dlnow);
+        return 0;
+    }
+
+    void sendWebRequest(const std::string& url, HttpResponse& ret) {
+        ret.header.clear();
+        ret.content.clear();
+        ret.curlCode = CURLE_OK;
+        ret.responseCode = 0;
+
         auto curl = curl_easy_init();
         if(!curl) {
             if(!isLoaded) showCriticalError("Failed to initialize curl, as a result files required to load BetterInfo won't be downloaded.\n\nIf the problem persists, you might want to look at the instructions for manual installation.");
             log("Failed to initialize curl");
-            return {"", "", CURLE_FAILED_INIT, 0};
+            ret.curlCode = CURLE_FAILED_INIT;
+            return;
         }
 
-        HttpResponse ret;
-
         curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, rateLimiter.rate > 0 ? 0L : 1L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, throttleTransfer);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &rateLimiter);
         curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
         curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
 
         curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeData);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &(ret.content));
-        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &(ret.header));
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ret);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, readHeader);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &ret);
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, FALSE);
         curl_easy_setopt(curl, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
         curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
         curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, TRUE);
 
+        rateLimiter.beginTransfer();
         ret.curlCode = curl_easy_perform(curl);
         curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &(ret.responseCode));
 
+        double nameLookupTime = 0, connectTime = 0, speed = 0, size = 0;
+        char* primaryIp = nullptr;
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &nameLookupTime);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connectTime);
+        curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &primaryIp);
+        curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD, &speed);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &size);
+        if(ret.curlCode == CURLE_OK) {
+            rateLimiter.sampleRtt(primaryIp ? primaryIp : url, connectTime - nameLookupTime);
+            rateLimiter.sampleThroughput(speed, size);
+        }
+
+        checkContent(ret);
+
+        curl_easy_cleanup(curl);
+        log(url + ": " + std::to_string(ret.responseCode));
+    }
+
+    /**
+     * Only bodies of successful transfers are judged, transport errors keep their own code so they never reach the negative cache.
+     * An empty body isn't proof the file is bad either, so it gets CURLE_GOT_NOTHING instead of CURLE_HTTP_RETURNED_ERROR.
+     */
+    void checkContent(HttpResponse& ret) {
+        if(ret.curlCode != CURLE_OK) return;
+
         if(ret.content.size() == 0) {
             log("Error: Empty file received");
-            ret.curlCode = CURLE_HTTP_RETURNED_ERROR;
+            ret.curlCode = CURLE_GOT_NOTHING;
+            return;
         }
 
-        if(ret.content.rfind("<html") == 0) {
+        if(ret.content.rfind("<html", 0) == 0) {
             log("Error: Invalid content - HTML detected");
             ret.curlCode = CURLE_HTTP_RETURNED_ERROR;
         }
@@ -168,22 +427,193 @@ public:
             log("Error: Invalid content - DOCTYPE detected");
             ret.curlCode = CURLE_HTTP_RETURNED_ERROR;
         }
+    }
 
-        curl_easy_cleanup(curl);
-        log(url + ": " + std::to_string(ret.responseCode));
-        return ret;
+    /**
+     * Transport backends, all of them report through HttpResponse so callers don't care where a file came from.
+     * Missing files are reported as CURLE_HTTP_RETURNED_ERROR / 404 like a server would.
+     */
+    void readFromDirectory(const std::string& path, HttpResponse& ret) {
+        ret.header.clear();
+        ret.content.clear();
+        ret.curlCode = CURLE_OK;
+        ret.responseCode = 200;
+
+        std::ifstream fileStream(path, std::ios::in | std::ios::binary | std::ios::ate);
+        if(!fileStream) {
+            ret.curlCode = CURLE_HTTP_RETURNED_ERROR;
+            ret.responseCode = 404;
+        } else {
+            auto size = (size_t) fileStream.tellg();
+            ret.reserve(size);
+            ret.content.resize(size);
+            fileStream.seekg(0);
+            if(!fileStream.read(ret.content.data(), size)) ret.curlCode = CURLE_READ_ERROR;
+            checkContent(ret);
+        }
+
+        log(path + ": " + std::to_string(ret.responseCode));
+    }
+
+    void readFromBundle(const std::string& file, HttpResponse& ret) {
+        ret.header.clear();
+        ret.content.clear();
+        ret.curlCode = CURLE_OK;
+        ret.responseCode = 200;
+
+        auto entry = transport.bundle.find(file);
+        if(entry == transport.bundle.end()) {
+            ret.curlCode = CURLE_HTTP_RETURNED_ERROR;
+            ret.responseCode = 404;
+        } else {
+            ret.reserve(entry->second.size());
+            ret.content.assign(entry->second);
+            checkContent(ret);
+        }
+
+        log("bundle:" + file + ": " + std::to_string(ret.responseCode));
+    }
+
+    void fetch(const std::string& file, HttpResponse& ret) {
+        switch(transport.kind) {
+            case TransportKind::Directory: readFromDirectory(transport.root + "/" + file, ret); break;
+            case TransportKind::Bundle: readFromBundle(file, ret); break;
+            default: sendWebRequest(transport.root + file, ret);
+        }
+    }
+
+    /**
+     * Absolute URLs always go to the network, anything else is looked up through the transport
+     */
+    void fetchLocation(const std::string& location, HttpResponse& ret) {
+        if(location.find("://") != std::string::npos) sendWebRequest(location, ret);
+        else fetch(location, ret);
+    }
+
+    /**
+     * Peer cache helper functions
+     */
+    static std::string sha256(const std::string& data) {
+        BCRYPT_ALG_HANDLE algorithm = nullptr;
+        BCRYPT_HASH_HANDLE hash = nullptr;
+        UCHAR digest[32];
+        std::string hex;
+
+        if(!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&algorithm, BCRYPT_SHA256_ALGORITHM, nullptr, 0))) return hex;
+        if(BCRYPT_SUCCESS(BCryptCreateHash(algorithm, &hash, nullptr, 0, nullptr, 0, 0))) {
+            if(BCRYPT_SUCCESS(BCryptHashData(hash, (PUCHAR) data.data(), (ULONG) data.size(), 0)) && BCRYPT_SUCCESS(BCryptFinishHash(hash, digest, sizeof(digest), 0))) {
+                constexpr char digits[] = "0123456789abcdef";
+                for(auto byte : digest) {
+                    hex += digits[byte >> 4];
+                    hex += digits[byte & 15];
+                }
+            }
+            BCryptDestroyHash(hash);
+        }
+        BCryptCloseAlgorithmProvider(algorithm, 0);
+        return hex;
+    }
+
+    void fetchFromPeer(const std::string& hash, HttpResponse& ret) {
+        if(peerCache.writable) readFromDirectory(peerCache.root + "/" + hash, ret);
+        else sendWebRequest(peerCache.root + hash, ret);
+    }
+
+    void storeInPeer(const std::string& hash, const std::string& data) {
+        auto path = peerCache.root + "/" + hash;
+        std::ofstream peerStream(path + ".tmp", std::ios::out | std::ios::binary);
+        peerStream.write(data.c_str(), data.size());
+        peerStream.close();
+
+        std::error_code error;
+        if(peerStream) std::filesystem::rename(path + ".tmp", path, error);
+        if(!peerStream || error) {
+            log("Failed to store in peer cache: " + path);
+            std::filesystem::remove(path + ".tmp", error);
+        }
+    }
+
+    /**
+     * Files with a published hash are tried from the peer cache first, then from the origin.
+     * Content not matching the published hash is rejected no matter where it came from.
+     */
+    void fetchVersionFile(const std::string& file, HttpResponse& ret) {
+        auto hash = peerCache.hashes.find(file);
+        if(hash == peerCache.hashes.end()) {
+            fetch(versionFile(file), ret);
+            return;
+        }
+
+        fetchFromPeer(hash->second, ret);
+        if(ret.curlCode == CURLE_OK && sha256(ret.content) == hash->second) {
+            log("Peer cache hit: " + file);
+            peerCache.hits++;
+            return;
+        }
+        if(ret.curlCode == CURLE_OK) log("Peer cache returned corrupt data for: " + file);
+        peerCache.misses++;
+
+        fetch(versionFile(file), ret);
+        if(ret.curlCode != CURLE_OK) return;
+        if(sha256(ret.content) != hash->second) {
+            log("Error: Hash mismatch for " + file);
+            ret.curlCode = CURLE_HTTP_RETURNED_ERROR;
+            return;
+        }
+
+        if(peerCache.writable) storeInPeer(hash->second, ret.content);
     }
 
     /**
      * Updater logic
      */
-    void dumpToFile(const std::string& path, std::string data) {
+    void dumpToFile(const std::string& path, const std::string& data) {
         std::ofstream fout(path, std::ios::out | std::ios::binary);
         fout.write(data.c_str(), data.size());
         fout.close();
         if(!fout) showFileWriteError(path);
     }
 
+    /**
+     * Written next to the target and renamed over it, so readers only ever see the old or the new file
+     */
+    bool writeAtomic(const std::string& path, const std::string& data) {
+        std::ofstream fout(path + ".tmp", std::ios::out | std::ios::binary);
+        fout.write(data.c_str(), data.size());
+        fout.close();
+
+        std::error_code error;
+        if(fout) std::filesystem::rename(path + ".tmp", path, error);
+        if(!fout || error) {
+            showFileWriteError(path);
+            return false;
+        }
+        return true;
+    }
+
+    std::string readMarker(const std::string& file) {
+        std::ifstream markerStream(BIpath(file));
+        std::string marker;
+        markerStream >> marker;
+        markerStream.close();
+        return marker;
+    }
+
+    std::vector<std::string> readList(const std::string& file) {
+        std::ifstream listStream(BIpath(file));
+        std::vector<std::string> list;
+        std::string entry;
+        while(listStream >> entry) list.push_back(entry);
+        listStream.close();
+        return list;
+    }
+
+    bool writeList(const std::string& file, const std::vector<std::string>& list) {
+        std::stringstream listStream;
+        for(const auto& entry : list) listStream << entry << "\n";
+        return writeAtomic(BIpath(file), listStream.str());
+    }
+
     std::string updateChannel() {
         if(!channel.empty()) return channel;
 
@@ -205,8 +635,265 @@ public:
         return channel;
     }
 
+    /**
+     * Bundles are a sequence of "<file> <size>\n" headers each followed by size bytes of content
+     */
+    bool loadBundle(const std::string& path) {
+        std::ifstream bundleStream(path, std::ios::in | std::ios::binary);
+        if(!bundleStream) return false;
+        transport.bundleData.assign(std::istreambuf_iterator<char>(bundleStream), std::istreambuf_iterator<char>());
+        bundleStream.close();
+
+        std::string_view data(transport.bundleData);
+        while(!data.empty()) {
+            auto headerEnd = data.find('\n');
+            if(headerEnd == std::string_view::npos) return false;
+            auto header = data.substr(0, headerEnd);
+            data.remove_prefix(headerEnd + 1);
+
+            auto nameEnd = header.find(' ');
+            size_t size = 0;
+            if(nameEnd == std::string_view::npos || std::from_chars(header.data() + nameEnd + 1, header.data() + header.size(), size).ec != std::errc() || size > data.size()) return false;
+
+            transport.bundle.emplace(std::string(header.substr(0, nameEnd)), data.substr(0, size));
+            data.remove_prefix(size);
+        }
+        return true;
+    }
+
+    /**
+     * transport.txt lines are "<channel|*> <curl|file|bundle> [root]", the first line matching the channel wins.
+     * curl roots must be http(s) URLs, file and bundle roots are paths or file:// URLs
+     */
+    void loadTransport() {
+        transport.kind = TransportKind::Curl;
+        transport.root = BIurlRoot;
+
+        std::ifstream transportStream(BIpath("transport.txt"));
+        std::string line;
+        while(std::getline(transportStream, line)) {
+            std::istringstream lineStream(line);
+            std::string transportChannel, backend, root;
+            lineStream >> transportChannel >> backend;
+            std::getline(lineStream >> std::ws, root);
+            root = trimView(root);
+            if(transportChannel != channel && transportChannel != "*") continue;
+
+            if(backend != "curl") root = fileUrlToPath(root);
+            if(backend == "curl" && (root.empty() || isHttpUrl(root))) {
+                if(!root.empty()) transport.root = root.back() == '/' ? root : root + "/";
+            } else if(backend == "file" && !root.empty()) {
+                transport.kind = TransportKind::Directory;
+                transport.root = root;
+            } else if(backend == "bundle" && loadBundle(root)) {
+                transport.kind = TransportKind::Bundle;
+                transport.root = root;
+            } else {
+                log("Ignoring invalid transport: " + line);
+                continue;
+            }
+            break;
+        }
+        transportStream.close();
+
+        log("Update transport: " + std::string(transport.kind == TransportKind::Directory ? "file " : transport.kind == TransportKind::Bundle ? "bundle " : "curl ") + transport.root);
+    }
+
+    /**
+     * peer_cache.txt holds either an http(s) endpoint or a shared directory, only directories are written back to
+     */
+    void loadPeerCache() {
+        std::ifstream peerStream(BIpath("peer_cache.txt"));
+        std::string root;
+        std::getline(peerStream, root);
+        peerStream.close();
+
+        root = trimView(root);
+        if(root.empty()) return;
+
+        peerCache.writable = !isHttpUrl(root);
+        if(peerCache.writable) root = fileUrlToPath(root);
+        if(!peerCache.writable && root.back() != '/') root += '/';
+        peerCache.root = root;
+        log("Using peer cache: " + peerCache.root);
+    }
+
+    /**
+     * hashes.txt lines are "<sha256> <file>" with files relative to the version directory
+     */
+    void loadHashes() {
+        peerCache.hashes.clear();
+        if(peerCache.root.empty()) return;
+
+        HttpResponse hashes;
+        fetch(versionFile("hashes.txt"), hashes);
+        if(hashes.curlCode != CURLE_OK) {
+            log("No hashes published for " + version + ", peer cache disabled");
+            return;
+        }
+
+        std::istringstream hashStream(hashes.content);
+        std::string hash, file;
+        while(hashStream >> hash >> file) {
+            std::transform(hash.begin(), hash.end(), hash.begin(), [](unsigned char c) { return (char) tolower(c); });
+            peerCache.hashes[file] = hash;
+        }
+    }
+
+    void loadBandwidthLimit() {
+        std::ifstream bandwidthStream(BIpath("bandwidth.txt"));
+        double limit = 0;
+        std::string mode;
+        bandwidthStream >> limit >> mode;
+        bandwidthStream.close();
+
+        if(limit <= 0) return;
+
+        rateLimiter.rate = rateLimiter.maxRate = limit * 1024;
+        rateLimiter.minRate = (std::min)(rateLimiter.minRate, rateLimiter.maxRate);
+        rateLimiter.adaptive = mode == "adaptive";
+        log("Limiting downloads to " + std::to_string((int) limit) + " KB/s" + (rateLimiter.adaptive ? " (adaptive)" : ""));
+    }
+
+    /**
+     * Staged resources only fill in files missing from Resources, same as direct downloads always did
+     */
+    void applyStagedResources(const std::string& stagedVersion) {
+        int applied = 0;
+        try {
+            for(const auto& entry : std::filesystem::directory_iterator(stagingPath(stagedVersion, "resources"))) {
+                auto resource = entry.path().filename().string();
+                if(resource.size() > 4 && resource.compare(resource.size() - 4, 4, ".tmp") == 0) continue;
+                if(resourceExists(resource)) continue;
+
+                std::error_code error;
+                if(std::filesystem::copy_file(entry.path(), resourcesPath(resource), error)) applied++;
+                else log("Failed to apply resource: " + resource);
+            }
+        } catch (...) {}
+
+        if(applied > 0) log("Applied " + std::to_string(applied) + " staged resources from " + stagedVersion);
+    }
+
+    /**
+     * history.txt lists activated versions newest first, only the first keptVersions stay staged
+     */
+    std::vector<std::string> versionHistory() {
+        auto history = readList("history.txt");
+        if(!history.empty()) return history;
+
+        for(auto marker : {"current.txt", "previous.txt"}) {
+            auto markedVersion = readMarker(marker);
+            if(!markedVersion.empty() && std::find(history.begin(), history.end(), markedVersion) == history.end()) history.push_back(markedVersion);
+        }
+        return history;
+    }
+
+    void removeStagedVersion(const std::string& stagedVersion) {
+        if(!validVersion(stagedVersion) || stagedVersion == loadedVersion) return;
+
+        std::error_code error;
+        std::filesystem::remove_all(stagingDirectory(stagedVersion), error);
+        log(error ? "Failed to remove staged version " + stagedVersion : "Removed staged version " + stagedVersion);
+    }
+
+    /**
+     * Failures that say nothing about the dll itself: a file locked by an antivirus scan, a process out of memory,
+     * or a dependency such as the VC runtime missing from the system
+     */
+    static bool environmentLoadError(DWORD error) {
+        return error == ERROR_ACCESS_DENIED || error == ERROR_SHARING_VIOLATION || error == ERROR_LOCK_VIOLATION
+            || error == ERROR_NOT_ENOUGH_MEMORY || error == ERROR_OUTOFMEMORY || error == ERROR_MOD_NOT_FOUND;
+    }
+
+    bool isBadVersion(const std::string& checkedVersion) {
+        auto badVersions = readList("bad_versions.txt");
+        return std::find(badVersions.begin(), badVersions.end(), checkedVersion) != badVersions.end();
+    }
+
+    /**
+     * Bad versions stay staged, so a forced update can retry them without downloading anything
+     */
+    void recordBadVersion(const std::string& badVersion) {
+        auto badVersions = readList("bad_versions.txt");
+        if(std::find(badVersions.begin(), badVersions.end(), badVersion) == badVersions.end()) badVersions.push_back(badVersion);
+        writeList("bad_versions.txt", badVersions);
+
+        auto history = versionHistory();
+        history.erase(std::remove(history.begin(), history.end(), badVersion), history.end());
+        writeList("history.txt", history);
+        log("Marked version " + badVersion + " as bad");
+    }
+
+    /**
+     * Undoes recordBadVersion and makes the version current again
+     */
+    void forgiveBadVersion(const std::string& badVersion) {
+        auto badVersions = readList("bad_versions.txt");
+        badVersions.erase(std::remove(badVersions.begin(), badVersions.end(), badVersion), badVersions.end());
+        writeList("bad_versions.txt", badVersions);
+
+        auto history = versionHistory();
+        history.insert(history.begin(), badVersion);
+        writeList("history.txt", history);
+        writeAtomic(BIpath("current.txt"), badVersion);
+        log("No longer marking version " + badVersion + " as bad");
+    }
+
+    /**
+     * Points current.txt at the newest good version that is still staged, empty if there is none left
+     */
+    std::string rollback() {
+        for(const auto& candidate : versionHistory()) {
+            if(!validVersion(candidate) || isBadVersion(candidate) || !std::filesystem::exists(stagingPath(candidate, "betterinfo.dll"))) continue;
+            if(!writeAtomic(BIpath("current.txt"), candidate)) break;
+            log("Rolled back to version " + candidate);
+            return candidate;
+        }
+
+        std::error_code error;
+        std::filesystem::remove(BIpath("current.txt"), error);
+        log("No staged version left to roll back to");
+        return "";
+    }
+
     bool loadBI() {
-        
+        auto current = readMarker("current.txt");
+        std::string blamedVersion;
+        DWORD blamedError = 0;
+        while(validVersion(current) && std::filesystem::exists(stagingPath(current, "betterinfo.dll"))) {
+            applyStagedResources(current);
+            isLoaded = (LoadLibrary(stagingPath(current, "betterinfo.dll").c_str()) != nullptr);
+            auto loadError = isLoaded ? 0 : GetLastError();
+            log(isLoaded ? "Loaded BetterInfo Mod " + current : "Failed to load BetterInfo Mod " + current + " (error " + std::to_string(loadError) + ")");
+            if(isLoaded) {
+                loadedVersion = current;
+                return isLoaded;
+            }
+
+            /**
+             * Without minhook every version fails to load, so that's not the version's fault either
+             */
+            if(!std::filesystem::exists("minhook.x32.dll") || environmentLoadError(loadError)) return isLoaded;
+
+            /**
+             * The version rolled back to failing the same way means the problem is the system, not the versions
+             */
+            if(!blamedVersion.empty() && loadError == blamedError) {
+                log("Version " + current + " failed like " + blamedVersion + ", not blaming versions for error " + std::to_string(loadError));
+                forgiveBadVersion(blamedVersion);
+                return isLoaded;
+            }
+
+            recordBadVersion(current);
+            blamedVersion = current;
+            blamedError = loadError;
+            current = rollback();
+        }
+
+        /**
+         * Legacy layout from before staging
+         */
         if(std::filesystem::exists(BIpath("betterinfo_updated.dll"))) {
             log("Found downloaded update, renaming dll");
             if(std::filesystem::exists(BIpath("betterinfo.dll"))) std::filesystem::remove(BIpath("betterinfo.dll"));
@@ -214,26 +901,283 @@ public:
         }
 
         isLoaded = (LoadLibrary(BIpath("betterinfo.dll").c_str()) != nullptr);
+        if(isLoaded) loadedVersion = readMarker("version.txt");
         log(isLoaded ? "Loaded BetterInfo Mod" : "Failed to load BetterInfo Mod");
         return isLoaded;
     }
 
+    /**
+     * The swap itself is the rename of current.txt, previous.txt keeps the version it replaced.
+     * Returns false if the version turned out to be bad and staging it should stop.
+     */
+    bool activateVersion(bool complete) {
+        if(!complete) {
+            log("Critical resources missing, not activating version " + version);
+            return true;
+        }
+
+        auto current = readMarker("current.txt");
+        if(current != version) {
+            if(!current.empty() && !writeAtomic(BIpath("previous.txt"), current)) return true;
+            if(!writeAtomic(BIpath("current.txt"), version)) return true;
+            log("Activated version " + version + (current.empty() ? "" : " (previous: " + current + ")"));
+        }
+
+        auto history = versionHistory();
+        history.erase(std::remove(history.begin(), history.end(), version), history.end());
+        history.insert(history.begin(), version);
+        for(size_t i = keptVersions; i < history.size(); i++) removeStagedVersion(history[i]);
+        for(const auto& badVersion : readList("bad_versions.txt")) {
+            if(badVersion != version) removeStagedVersion(badVersion);
+        }
+        if(history.size() > keptVersions) history.resize(keptVersions);
+        writeList("history.txt", history);
+
+        if(!isLoaded) loadBI();
+        return !isBadVersion(version);
+    }
+
+    bool stageLegacyDll() {
+        if(!std::filesystem::exists(BIpath("betterinfo.dll"))) return false;
+
+        std::error_code error;
+        std::filesystem::copy_file(BIpath("betterinfo.dll"), stagingPath(version, "betterinfo.dll.tmp"), std::filesystem::copy_options::overwrite_existing, error);
+        if(!error) std::filesystem::rename(stagingPath(version, "betterinfo.dll.tmp"), stagingPath(version, "betterinfo.dll"), error);
+        if(!error) log("Staged installed version " + version);
+        return !error;
+    }
+
     bool loadMinhook() {
         return LoadLibrary("minhook.x32.dll") != nullptr || std::filesystem::exists("minhook.x32.dll");
     }
 
     std::string installedVersion() {
-        std::ifstream versionStream(BIpath("version.txt"));
-        std::string installedVersion;
-        versionStream >> installedVersion;
-        versionStream.close();
-        return installedVersion;
+        auto current = readMarker("current.txt");
+        return current.empty() ? readMarker("version.txt") : current;
     }
 
     bool resourceExists(const std::string& resource) {
         return std::filesystem::exists(resourcesPath(resource));
     }
 
+    /**
+     * Update check cache
+     */
+    time_t checkInterval() {
+        std::ifstream intervalStream(BIpath("check_interval.txt"));
+        std::string intervalChannel;
+        time_t interval;
+        while(intervalStream >> intervalChannel >> interval) {
+            if(intervalChannel == channel) return interval;
+        }
+        return defaultCheckInterval;
+    }
+
+    /**
+     * A forced check also forgives versions that failed to load, so they get downloaded and tried again
+     */
+    bool forcedUpdate() {
+        if(!std::filesystem::exists(BIpath("force_update.txt"))) return false;
+        log("Forced update check requested, clearing bad versions");
+        std::error_code error;
+        std::filesystem::remove(BIpath("bad_versions.txt"), error);
+        std::filesystem::remove(BIpath("force_update.txt"), error);
+        return true;
+    }
+
+    bool recentlyChecked() {
+        std::ifstream checkStream(BIpath("last_check.txt"));
+        std::string checkedChannel;
+        time_t checkedAt = 0;
+        checkStream >> checkedChannel >> checkedAt;
+        checkStream.close();
+
+        auto now = std::time(nullptr);
+        return checkedChannel == channel && checkedAt <= now && now - checkedAt < checkInterval();
+    }
+
+    void saveCheckTime() {
+        std::stringstream checkStream;
+        checkStream << channel << " " << std::time(nullptr);
+        dumpToFile(BIpath("last_check.txt"), checkStream.str());
+    }
+
+    /**
+     * Negative cache for resources that failed to download
+     */
+    void loadFailedResources() {
+        failedResources.clear();
+
+        std::ifstream failedStream(BIpath("failed_resources.txt"));
+        std::string failedVersion;
+        std::string resource;
+        ResourceFailure failure;
+        while(failedStream >> failedVersion >> resource >> failure.failures >> failure.nextCheck) {
+            if(failedVersion == version) failedResources[resource] = failure;
+        }
+        failedStream.close();
+
+        for(const auto& [resource, failure] : failedResources) {
+            log("Suppressed resource: " + resource + " (" + std::to_string(failure.failures) + " failures)");
+        }
+    }
+
+    void saveFailedResources() {
+        std::stringstream failedStream;
+        for(const auto& [resource, failure] : failedResources) {
+            failedStream << version << " " << resource << " " << failure.failures << " " << failure.nextCheck << "\n";
+        }
+        dumpToFile(BIpath("failed_resources.txt"), failedStream.str());
+    }
+
+    bool resourceSuppressed(const std::string& resource) {
+        auto failure = failedResources.find(resource);
+        return failure != failedResources.end() && std::time(nullptr) < failure->second.nextCheck;
+    }
+
+    void recordResourceFailure(const std::string& resource) {
+        auto& failure = failedResources[resource];
+        failure.failures++;
+
+        time_t interval = resourceRetryInterval;
+        for(int i = 1; i < failure.failures && interval < maxResourceRetryInterval; i++) interval *= 2;
+        if(interval > maxResourceRetryInterval) interval = maxResourceRetryInterval;
+        failure.nextCheck = std::time(nullptr) + interval;
+
+        log("Suppressing resource " + resource + " for " + std::to_string(interval) + " seconds");
+    }
+
+    /**
+     * Manifest lines are "<resource> [priority]", lower priorities are needed first
+     */
+    std::vector<ResourceEntry> parseResources(std::string_view manifest) {
+        std::vector<ResourceEntry> resources;
+
+        while(!manifest.empty()) {
+            auto lineEnd = manifest.find('\n');
+            auto line = trimView(manifest.substr(0, lineEnd));
+            manifest.remove_prefix(lineEnd == std::string_view::npos ? manifest.size() : lineEnd + 1);
+            if(line.empty()) continue;
+
+            auto nameEnd = line.find_first_of(" \t");
+            int priority = defaultResourcePriority;
+            auto rankBegin = nameEnd == std::string_view::npos ? nameEnd : line.find_first_not_of(" \t", nameEnd);
+            if(rankBegin != std::string_view::npos) {
+                auto rank = line.substr(rankBegin);
+                std::from_chars(rank.data(), rank.data() + rank.size(), priority);
+            }
+
+            resources.push_back({std::string(line.substr(0, nameEnd)), priority});
+        }
+
+        std::stable_sort(resources.begin(), resources.end(), [](const ResourceEntry& a, const ResourceEntry& b) {
+            return a.priority < b.priority;
+        });
+        return resources;
+    }
+
+    /**
+     * Prefetching is opt-in, prefetch.txt lists the channels it's enabled for ("*" for all)
+     */
+    bool prefetchEnabled() {
+        auto channels = readList("prefetch.txt");
+        return std::find_if(channels.begin(), channels.end(), [this](const std::string& prefetchChannel) {
+            return prefetchChannel == channel || prefetchChannel == "*";
+        }) != channels.end();
+    }
+
+    /**
+     * Called when a new version is about to be staged, it's a hit if a prefetch already staged its dll.
+     * prefetch_stats.txt is "<hits> <misses> <last counted version>" so retries of the same version count once.
+     */
+    void recordPrefetchResult() {
+        std::ifstream statsStream(BIpath("prefetch_stats.txt"));
+        int hits = 0, misses = 0;
+        std::string counted;
+        statsStream >> hits >> misses >> counted;
+        statsStream.close();
+        if(counted == version) return;
+
+        auto prefetched = readList("prefetched.txt");
+        auto entry = std::find(prefetched.begin(), prefetched.end(), version);
+        bool hit = entry != prefetched.end() && std::filesystem::exists(stagingPath(version, "betterinfo.dll"));
+        if(entry != prefetched.end()) {
+            prefetched.erase(entry);
+            writeList("prefetched.txt", prefetched);
+        }
+
+        if(hit) hits++;
+        else misses++;
+        dumpToFile(BIpath("prefetch_stats.txt"), std::to_string(hits) + " " + std::to_string(misses) + " " + version);
+        log(std::string(hit ? "Prefetch hit" : "Prefetch miss") + " for version " + version + ", hit rate " + std::to_string(hits) + "/" + std::to_string(hits + misses));
+    }
+
+    /**
+     * Stages the dll and missing resources of the version without activating it
+     */
+    bool stageVersion(HttpResponse& response) {
+        loadHashes();
+
+        if(!std::filesystem::exists(stagingPath(version, "betterinfo.dll"))) {
+            fetchVersionFile("betterinfo.dll", response);
+            if(response.curlCode != CURLE_OK || !writeAtomic(stagingPath(version, "betterinfo.dll"), response.content)) return false;
+        }
+
+        HttpResponse manifest;
+        fetch(versionFile("resources.txt"), manifest);
+        if(manifest.curlCode != CURLE_OK) return false;
+        tryCreateDirectory(stagingPath(version, "resources"));
+
+        for(const auto& [resource, priority] : parseResources(manifest.content)) {
+            if(resourceExists(resource) || std::filesystem::exists(stagingPath(version, resourceFile(resource)))) continue;
+
+            fetchVersionFile(resourceFile(resource), response);
+            if(response.curlCode == CURLE_OK) writeAtomic(stagingPath(version, resourceFile(resource)), response.content);
+        }
+        return true;
+    }
+
+    /**
+     * Runs once the game is up, stages the build announced in the channel's next.txt so the next update is a local swap.
+     * Shares the update check's freshness, a launch that skipped the check stays off the network here too.
+     */
+    void prefetchNext() {
+        if(!isLoaded || !checkedOnline || channel.empty() || channel == "disabled" || !prefetchEnabled()) return;
+        Sleep((DWORD) (prefetchDelay * 1000));
+
+        HttpResponse response;
+        fetch(channelFile("next.txt"), response);
+        if(response.curlCode != CURLE_OK) return;
+        std::string next(trimView(response.content));
+        if(!validVersion(next) || next == installedVersion() || isBadVersion(next)) return;
+
+        auto prefetched = readList("prefetched.txt");
+        if(std::find(prefetched.begin(), prefetched.end(), next) != prefetched.end() && std::filesystem::exists(stagingPath(next, "betterinfo.dll"))) {
+            log("Version " + next + " is already prefetched");
+            return;
+        }
+
+        /**
+         * Earlier prefetches that never got activated are dropped in favor of the new one
+         */
+        auto history = versionHistory();
+        for(const auto& stale : prefetched) {
+            if(stale != next && std::find(history.begin(), history.end(), stale) == history.end()) removeStagedVersion(stale);
+        }
+        writeList("prefetched.txt", {next});
+
+        auto currentVersion = version;
+        version = next;
+        log("Prefetching version " + version);
+        log(stageVersion(response) ? "Prefetched version " + version + " after " + elapsedTime() : "Failed to prefetch version " + version);
+        version = currentVersion;
+    }
+
+    void logCriticalResources(bool missing) {
+        if(missing) log("Critical resources incomplete after " + elapsedTime());
+        else log("Critical resources ready after " + elapsedTime());
+    }
+
     void updateFromV1() {
         if(std::filesystem::exists(BIpathV1("channel.txt"))) dumpToFile(BIpathV1("channel.txt"), "disabled");
     }
@@ -246,58 +1190,115 @@ public:
 
         if(updateChannel() == "disabled") return;
         updateFromV1();
+        loadTransport();
+        loadPeerCache();
+        loadBandwidthLimit();
 
         /**
          * Try to load minhook and download if failed
          */
+        HttpResponse response;
         if(!loadMinhook()) {
-            auto response = sendWebRequest(channelUrl("minhook.txt"));
+            fetch(channelFile("minhook.txt"), response);
             if(response.curlCode != CURLE_OK) { if(!isLoaded) showDownloadError(); return; }
-            trimString(response.content);
-            response = sendWebRequest(response.content);
+            std::string minhookUrl(trimView(response.content));
+            fetchLocation(minhookUrl, response);
             if(response.curlCode != CURLE_OK) { if(!isLoaded) showDownloadError(); return; }
             dumpToFile("minhook.x32.dll", response.content);
             isLoaded = loadBI();
         }
 
+        /**
+         * Skip the network entirely if the last check is still fresh
+         */
+        bool forced = forcedUpdate();
+        if(isLoaded && !forced && recentlyChecked()) {
+            log("Skipping update check, last check is still fresh");
+            return;
+        }
+        checkedOnline = true;
+
         /**
          * Checking for new version
          */
-        auto response = sendWebRequest(channelUrl("version.txt"));
+        fetch(channelFile("version.txt"), response);
         if(response.curlCode != CURLE_OK) { if(!isLoaded) showDownloadError(); return; }
-        version = response.content;
-        trimString(version);
+        version = trimView(response.content);
+        if(!validVersion(version)) {
+            log("Ignoring invalid version \"" + version + "\"");
+            if(!isLoaded) showDownloadError();
+            return;
+        }
+        if(isBadVersion(version)) {
+            log("Skipping version " + version + ", it failed to load before");
+            if(!isLoaded) showBadVersionError();
+            saveCheckTime();
+            return;
+        }
+        loadHashes();
 
         /**
-         * Download new version if online version doesn't match offline version
+         * Stage the new version if online version doesn't match offline version, the installed one stays untouched
          */
         std::string installedVersion(installedVersion());
-        if(installedVersion.empty() || installedVersion != version || !std::filesystem::exists(BIpath("betterinfo.dll"))) {
-            response = sendWebRequest(versionUrl("betterinfo.dll"));
+        bool staging = installedVersion.empty() || installedVersion != version || !std::filesystem::exists(stagingPath(version, "betterinfo.dll"));
+        if(staging && !installedVersion.empty() && installedVersion != version && prefetchEnabled()) recordPrefetchResult();
+        if(staging && !std::filesystem::exists(stagingPath(version, "betterinfo.dll")) && !(installedVersion == version && stageLegacyDll())) {
+            fetchVersionFile("betterinfo.dll", response);
             if(response.curlCode != CURLE_OK) { if(!isLoaded) showDownloadError(); return; }
-
-            dumpToFile(BIpath("betterinfo_updated.dll"), response.content);
-            if(!isLoaded) loadBI();
-
-            dumpToFile(BIpath("version.txt"), version);
+            if(!writeAtomic(stagingPath(version, "betterinfo.dll"), response.content)) return;
         }
 
         /**
-         * Verify if all resources are present and download ones that aren't
+         * Verify if all resources are present and stage ones that aren't, the version is activated once critical ones are in
          */
-        response = sendWebRequest(versionUrl("resources.txt"));
-        if(response.curlCode != CURLE_OK) return;
-        std::stringstream responseStream(response.content);
+        HttpResponse manifest;
+        fetch(versionFile("resources.txt"), manifest);
+        if(manifest.curlCode != CURLE_OK) { if(!isLoaded) showDownloadError(); return; }
+        auto resources = parseResources(manifest.content);
+        loadFailedResources();
+        tryCreateDirectory(stagingPath(version, "resources"));
+
+        bool criticalReady = false;
+        bool criticalMissing = false;
+        bool anyMissing = false;
+        for(const auto& [resource, priority] : resources) {
+            if(!criticalReady && priority > criticalResourcePriority) {
+                logCriticalResources(criticalMissing);
+                criticalReady = true;
+                if(staging && !activateVersion(!criticalMissing)) return;
+            }
 
-        for(std::string resource; std::getline(responseStream, resource); ) {
-            trimString(resource);
-            if(resourceExists(resource)) continue;
+            if(resourceExists(resource) || std::filesystem::exists(stagingPath(version, resourceFile(resource)))) continue;
+            if(resourceSuppressed(resource)) {
+                criticalMissing = criticalMissing || priority <= criticalResourcePriority;
+                anyMissing = true;
+                continue;
+            }
 
-            response = sendWebRequest(versionResourcesUrl(resource));
-            if(response.curlCode != CURLE_OK) continue;
+            fetchVersionFile(resourceFile(resource), response);
+            if(response.curlCode == CURLE_HTTP_RETURNED_ERROR) recordResourceFailure(resource);
+            else if(response.curlCode != CURLE_OK) log("Not suppressing " + resource + " after transport error " + std::to_string(response.curlCode));
+            if(response.curlCode != CURLE_OK || !writeAtomic(stagingPath(version, resourceFile(resource)), response.content)) {
+                criticalMissing = criticalMissing || priority <= criticalResourcePriority;
+                anyMissing = true;
+                continue;
+            }
 
-            dumpToFile(resourcesPath(resource), response.content);
+            failedResources.erase(resource);
         }
+
+        if(!criticalReady) {
+            logCriticalResources(criticalMissing);
+            if(staging && !activateVersion(!criticalMissing)) return;
+        }
+        if(loadedVersion == version) applyStagedResources(version);
+        log(std::string(anyMissing ? "Resources incomplete after " : "All resources ready after ") + elapsedTime());
+        saveFailedResources();
+        if(!peerCache.hashes.empty()) log("Peer cache: " + std::to_string(peerCache.hits) + " hits, " + std::to_string(peerCache.misses) + " misses");
+        log("Response buffers allocated " + std::to_string(HttpResponse::allocations) + " times");
+
+        saveCheckTime();
     }
 };
 
@@ -322,9 +1323,10 @@ DWORD WINAPI my_thread(void* hModule) {
     }
 
     /**
-     * Start the main update check and loading operation
+     * Start the main update check and loading operation, then prefetch the next build while idle
      */
-    Updater();
+    Updater updater;
+    updater.prefetchNext();
 
     return 0;
 }
@@ -0,0 +1,345 @@
+// Timings for libraries/fts_fuzzy_match.h, mostly in nanoseconds per candidate, next to the 0.2.0 recursive matcher or
+// a plain loop where there is an old equivalent. --quick runs each measurement once on smaller corpora, as a smoke test.
+
+#define FTS_FUZZY_MATCH_IMPLEMENTATION
+#include "fts_fuzzy_match.h"
+#include "fts_fuzzy_match_corpus.h"
+#include "fts_fuzzy_match_reference.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+    #include <fcntl.h>  // posix_fadvise
+    #include <unistd.h> // fsync, close
+#endif
+
+static bool quick = false;
+static volatile long long sink = 0;
+
+// Best of several runs, in nanoseconds per candidate
+template <typename F> static double measure(int candidates, F && run) {
+    int repeats = quick ? 1 : 5;
+    double best = 0;
+    for (int r = 0; r < repeats; ++r) {
+        auto begin = std::chrono::steady_clock::now();
+        run();
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best / candidates;
+}
+
+static std::string quote(const char * pattern) {
+    char quoted[64];
+    snprintf(quoted, sizeof(quoted), "\"%.24s\"", pattern);
+    return quoted;
+}
+
+static void bench_corpus(const fts_corpus::corpus & corpus) {
+    const int count = (int)corpus.pointers.size();
+    const char * const * strs = corpus.pointers.data();
+
+    fts::fuzzy_index index;
+    fts::fuzzy_index_build(index, strs, count);
+
+    printf("%s (%d candidates)\n", corpus.name, count);
+    printf("  %-28s %10s %10s %10s %10s\n", "pattern", "recursive", "match", "list", "index");
+    for (const char * pattern : corpus.patterns) {
+        double recursive = measure(count, [&] {
+            for (int i = 0; i < count; ++i) {
+                int score = 0;
+                sink += fts_reference::fuzzy_match(pattern, strs[i], score) ? score : 0;
+            }
+        });
+        double match = measure(count, [&] {
+            for (int i = 0; i < count; ++i) {
+                int score = 0;
+                sink += fts::fuzzy_match(pattern, strs[i], score) ? score : 0;
+            }
+        });
+
+        fts::fuzzy_result results[20];
+        double list = measure(count, [&] { sink += fts::fuzzy_search(pattern, strs, count, results, 20); });
+        double indexed = measure(count, [&] { sink += fts::fuzzy_search(index, pattern, results, 20); });
+
+        printf("  %-28s %10.1f %10.1f %10.1f %10.1f\n", quote(pattern).c_str(), recursive, match, list, indexed);
+    }
+}
+
+// fuzzy_search_parallel from one thread up to every hardware thread
+static void bench_parallel(const fts_corpus::corpus & corpus) {
+    const int count = (int)corpus.pointers.size();
+    const int maxThreads = (std::max)(1, (int)std::thread::hardware_concurrency());
+
+    fts::fuzzy_index index;
+    fts::fuzzy_index_build(index, corpus.pointers.data(), count);
+
+    printf("parallel over %s (%d candidates)\n", corpus.name, count);
+    printf("  %-28s", "pattern \\ threads");
+    for (int threads = 1; threads <= maxThreads; ++threads)
+        printf(" %8d", threads);
+    printf("\n");
+    for (const char * pattern : corpus.patterns) {
+        printf("  %-28s", quote(pattern).c_str());
+        for (int threads = 1; threads <= maxThreads; ++threads) {
+            fts::fuzzy_result results[20];
+            printf(" %8.1f", measure(count, [&] { sink += fts::fuzzy_search_parallel(index, pattern, results, 20, threads); }));
+        }
+        printf("\n");
+    }
+}
+
+// Rejecting non-matches: fuzzy_filter against calling the old fuzzy_match_simple per candidate
+static void bench_filter(const fts_corpus::corpus & corpus) {
+    const int count = (int)corpus.pointers.size();
+    const char * const * strs = corpus.pointers.data();
+    std::vector<int> survivors(count);
+
+    printf("filter over %s (%d candidates)\n", corpus.name, count);
+    printf("  %-28s %10s %10s %10s\n", "pattern", "reference", "filter", "survivors");
+    for (const char * pattern : corpus.patterns) {
+        int kept = 0;
+        double reference = measure(count, [&] {
+            kept = 0;
+            for (int i = 0; i < count; ++i)
+                kept += fts_reference::fuzzy_match_simple(pattern, strs[i]);
+        });
+        double filter = measure(count, [&] { sink += fts::fuzzy_filter(pattern, strs, count, survivors.data()); });
+
+        printf("  %-28s %10.1f %10.1f %10d\n", quote(pattern).c_str(), reference, filter, kept);
+    }
+}
+
+// Search-as-you-type: microseconds per keystroke for a session against a fresh index search on every prefix
+static void bench_session(const fts_corpus::corpus & corpus) {
+    const int count = (int)corpus.pointers.size();
+    fts::fuzzy_index index;
+    fts::fuzzy_index_build(index, corpus.pointers.data(), count);
+
+    printf("session over %s (%d candidates), us per keystroke\n", corpus.name, count);
+    printf("  %-28s %10s %10s\n", "pattern", "search", "session");
+    for (const char * pattern : corpus.patterns) {
+        std::vector<std::string> prefixes;
+        for (const char * c = pattern; *c; ) {
+            do { ++c; } while ((*c & 0xC0) == 0x80);
+            prefixes.emplace_back(pattern, c);
+        }
+
+        fts::fuzzy_result results[20];
+        int keystrokes = (int)prefixes.size();
+        double search = measure(keystrokes, [&] {
+            for (const std::string & prefix : prefixes)
+                sink += fts::fuzzy_search(index, prefix.c_str(), results, 20);
+        });
+        double session = measure(keystrokes, [&] {
+            fts::fuzzy_session typing;
+            fts::fuzzy_session_init(typing, index);
+            for (const std::string & prefix : prefixes)
+                sink += fts::fuzzy_session_update(typing, prefix.c_str(), results, 20);
+        });
+        printf("  %-28s %10.1f %10.1f\n", quote(pattern).c_str(), search / 1000, session / 1000);
+    }
+}
+
+// Inverted index: its memory next to the index it covers, and ns/candidate against the linear index scan
+static void bench_postings(const fts_corpus::corpus & corpus) {
+    const int count = (int)corpus.pointers.size();
+    fts::fuzzy_index index;
+    fts::fuzzy_index_build(index, corpus.pointers.data(), count);
+    fts::fuzzy_postings postings;
+    fts::fuzzy_postings_update(postings, index);
+
+    size_t indexBytes = index.lower.capacity() + index.boundary.capacity()
+        + (index.offsets.capacity() + index.presence.capacity()) * sizeof(uint32_t);
+    printf("postings over %s (%d candidates): %zu KiB, index %zu KiB\n", corpus.name, count,
+        fts::fuzzy_postings_memory(postings) / 1024, indexBytes / 1024);
+    printf("  %-28s %10s %10s\n", "pattern", "linear", "postings");
+    for (const char * pattern : corpus.patterns) {
+        fts::fuzzy_result results[20];
+        double linear = measure(count, [&] { sink += fts::fuzzy_search(index, pattern, results, 20); });
+        double posted = measure(count, [&] { sink += fts::fuzzy_search(index, postings, pattern, results, 20); });
+        printf("  %-28s %10.1f %10.1f\n", quote(pattern).c_str(), linear, posted);
+    }
+}
+
+// Drops the file from the page cache where the platform allows it, so the next open reads from disk
+static bool evict(const char * path) {
+#ifdef __linux__
+    int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+    bool evicted = fsync(file) == 0 && posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(file);
+    return evicted;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+// Time to the first query in milliseconds: building the index in memory, opening an index file straight from disk
+// and opening it again while it is still in the page cache
+static void bench_mapped(const fts_corpus::corpus & corpus, const char * pattern) {
+    const int count = (int)corpus.pointers.size();
+    const char * path = "fts_fuzzy_match_bench.idx";
+    fts::fuzzy_result results[20];
+
+    auto begin = std::chrono::steady_clock::now();
+    fts::fuzzy_index index;
+    fts::fuzzy_index_build(index, corpus.pointers.data(), count);
+    sink += fts::fuzzy_search(index, pattern, results, 20);
+    double build = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+    remove(path);
+    if (!fts::fuzzy_index_append(path, index, 0)) {
+        printf("mapped over %s: could not write %s\n", corpus.name, path);
+        return;
+    }
+
+    auto firstQuery = [&] {
+        auto start = std::chrono::steady_clock::now();
+        fts::fuzzy_mapped_index mapped;
+        if (fts::fuzzy_index_open(mapped, path))
+            sink += fts::fuzzy_search(mapped, pattern, results, 20);
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        fts::fuzzy_index_close(mapped);
+        return elapsed;
+    };
+    bool evicted = evict(path);
+    double cold = firstQuery();
+    double warm = firstQuery();
+    remove(path);
+
+    printf("mapped over %s (%d candidates), first %s query in ms\n", corpus.name, count, quote(pattern).c_str());
+    printf("  build %.2f, %s %.2f, warm file %.2f\n", build, evicted ? "cold file" : "file (not evicted)", cold, warm);
+}
+
+// Where top-k pruning sends the candidates that pass the prefilter
+static void bench_pruning(const fts_corpus::corpus & corpus) {
+    const int count = (int)corpus.pointers.size();
+    fts::fuzzy_index index;
+    fts::fuzzy_index_build(index, corpus.pointers.data(), count);
+
+    printf("pruning over %s (%d candidates), top 20\n", corpus.name, count);
+    printf("  %-28s %10s %10s %10s %10s\n", "pattern", "filtered", "pruned", "scored", "pruned %");
+    for (const char * pattern : corpus.patterns) {
+        fts::fuzzy_result results[20];
+        fts::fuzzy_search_stats stats;
+        fts::fuzzy_search(index, pattern, results, 20, &stats);
+        int passed = stats.pruned + stats.scored;
+        printf("  %-28s %10d %10d %10d %10.1f\n", quote(pattern).c_str(), stats.filtered, stats.pruned, stats.scored,
+            passed ? 100.0 * stats.pruned / passed : 0.0);
+    }
+}
+
+// Multi-term search against matching each term separately and summing, ns/candidate
+static void bench_terms(const fts_corpus::corpus & corpus) {
+    const int count = (int)corpus.pointers.size();
+    const char * const * strs = corpus.pointers.data();
+    fts::fuzzy_index index;
+    fts::fuzzy_index_build(index, strs, count);
+
+    printf("terms over %s (%d candidates)\n", corpus.name, count);
+    printf("  %-28s %10s %10s\n", "pattern", "per term", "terms");
+    for (const char * pattern : corpus.patterns) {
+        std::vector<std::string> terms;
+        for (const char * c = pattern; *c; ) {
+            const char * end = strchr(c, ' ');
+            if (!end)
+                end = c + strlen(c);
+            if (end > c)
+                terms.emplace_back(c, end);
+            c = *end ? end + 1 : end;
+        }
+
+        fts::fuzzy_result results[20];
+        std::vector<fts::fuzzy_result> matched;
+        double loop = measure(count, [&] {
+            matched.clear();
+            for (int i = 0; i < count; ++i) {
+                fts::fuzzy_result result = { i, 0 };
+                bool all = true;
+                for (size_t t = 0; t < terms.size() && all; ++t) {
+                    int score = 0;
+                    all = fts::fuzzy_match(terms[t].c_str(), strs[i], score);
+                    result.score += score;
+                }
+                if (all)
+                    matched.push_back(result);
+            }
+            int kept = (std::min)((int)matched.size(), 20);
+            std::partial_sort(matched.begin(), matched.begin() + kept, matched.end(), [](const fts::fuzzy_result & a, const fts::fuzzy_result & b) {
+                return a.score != b.score ? a.score > b.score : a.index < b.index;
+            });
+            sink += kept;
+        });
+        double combined = measure(count, [&] { sink += fts::fuzzy_search_terms(index, pattern, results, 20); });
+        printf("  %-28s %10.1f %10.1f\n", quote(pattern).c_str(), loop, combined);
+    }
+}
+
+// Highlighting a page of results: ranges from the index against int positions from the original strings, ns/result
+static void bench_highlight(const fts_corpus::corpus & corpus) {
+    const int count = (int)corpus.pointers.size();
+    const int page = 1000;
+    fts::fuzzy_index index;
+    fts::fuzzy_index_build(index, corpus.pointers.data(), count);
+    std::vector<fts::fuzzy_result> results(page);
+
+    printf("highlighting up to %d results over %s, ns per result\n", page, corpus.name);
+    printf("  %-28s %10s %10s %10s\n", "pattern", "results", "positions", "ranges");
+    for (const char * pattern : corpus.patterns) {
+        int resultCount = fts::fuzzy_search(index, pattern, results.data(), page);
+        if (resultCount == 0)
+            continue;
+
+        double positions = measure(resultCount, [&] {
+            for (int r = 0; r < resultCount; ++r) {
+                int score = 0;
+                int matches[256];
+                sink += fts::fuzzy_match(pattern, corpus.pointers[results[r].index], score, matches, 256);
+            }
+        });
+        double ranges = measure(resultCount, [&] {
+            for (int r = 0; r < resultCount; ++r) {
+                int score = 0, rangeCount = 0;
+                fts::fuzzy_range spans[64];
+                sink += fts::fuzzy_match_ranges(index, results[r].index, pattern, score, spans, 64, rangeCount);
+            }
+        });
+        printf("  %-28s %10d %10.1f %10.1f\n", quote(pattern).c_str(), resultCount, positions, ranges);
+    }
+}
+
+int main(int argc, char ** argv) {
+    quick = argc > 1 && strcmp(argv[1], "--quick") == 0;
+    int scale = quick ? 10 : 1;
+
+    bench_corpus(fts_corpus::level_names(100000 / scale));
+    bench_corpus(fts_corpus::creator_names(100000 / scale));
+    bench_corpus(fts_corpus::descriptions(20000 / scale));
+    bench_corpus(fts_corpus::pathological(3000 / scale));
+    bench_parallel(fts_corpus::level_names(100000 / scale));
+    bench_parallel(fts_corpus::descriptions(20000 / scale));
+    bench_filter(fts_corpus::level_names(100000 / scale));
+    bench_filter(fts_corpus::descriptions(20000 / scale));
+    bench_session(fts_corpus::level_names(100000 / scale));
+    bench_session(fts_corpus::creator_names(100000 / scale));
+    bench_postings(fts_corpus::level_names(100000 / scale));
+    bench_postings(fts_corpus::creator_names(100000 / scale));
+    bench_mapped(fts_corpus::level_names(300000 / scale), "toe");
+    bench_pruning(fts_corpus::level_names(100000 / scale));
+    bench_pruning(fts_corpus::descriptions(20000 / scale));
+    bench_terms(fts_corpus::level_names(100000 / scale));
+    bench_terms(fts_corpus::descriptions(20000 / scale));
+    bench_highlight(fts_corpus::level_names(100000 / scale));
+    bench_highlight(fts_corpus::descriptions(20000 / scale));
+    return 0;
+}
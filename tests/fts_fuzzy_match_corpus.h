@@ -0,0 +1,130 @@
+// Deterministic candidate lists shaped like what BetterInfo searches: level names, creator names, level descriptions,
+// and the repeated-character cases the matcher has to survive. Shared by the test suite and the benchmark.
+
+#ifndef FTS_FUZZY_MATCH_CORPUS_H
+#define FTS_FUZZY_MATCH_CORPUS_H
+
+#include <ctype.h>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fts_corpus {
+    struct corpus {
+        const char * name;
+        std::vector<std::string> strings;
+        std::vector<const char *> pointers;
+        std::vector<const char *> patterns;
+    };
+
+    template <typename T, int N> static const T & pick(T (&items)[N], std::mt19937 & rng) {
+        return items[rng() % N];
+    }
+
+    static void finish(corpus & out) {
+        out.pointers.clear();
+        for (const std::string & str : out.strings)
+            out.pointers.push_back(str.c_str());
+    }
+
+    // Level names: one to four words joined by spaces or underscores, with the casing, suffixes and occasional
+    // non-ASCII titles seen on the servers.
+    static corpus level_names(int count, unsigned seed = 1) {
+        static const char * words[] = {
+            "Bloodbath", "Sonic", "Wave", "Deadlocked", "Theory", "of", "Everything", "Cataclysm", "Acu", "Tartarus",
+            "Slaughterhouse", "Nine", "Circles", "Kenos", "Zodiac", "Yatagarasu", "Clubstep", "Electrodynamix", "Hexagon",
+            "Force", "Blast", "Processor", "Toxic", "Factory", "Windy", "Landscape", "Future", "Funk", "Bloodlust",
+            "Abyss", "Silent", "Nebula", "Firework", "Jawbreaker", "Acheron", "Sakupen", "Hell", "Limbo", "Erebus",
+            "Crimson", "Planet", "Duelo", "Maestro", "Avernus", "Cognition", "Aftermath", "Sigma", "Zenith", "Delta"
+        };
+        static const char * suffixes[] = { "", "", "", "", " v2", " II", " XL", " 2.2", " Remake", " Layout" };
+        static const char * unicode[] = { "Élan", "Жизнь", "Ωmega", "Ärger", "Ｆｕｌｌ" };
+
+        corpus out{ "level names", {}, {}, { "bb", "sonic wave", "dl", "toe", "tart", "xl", "élan", "zzz" } };
+        std::mt19937 rng(seed);
+        for (int i = 0; i < count; ++i) {
+            std::string name;
+            int wordCount = 1 + (int)(rng() % 4);
+            char joiner = rng() % 4 == 0 ? '_' : ' ';
+            for (int w = 0; w < wordCount; ++w) {
+                if (w)
+                    name += joiner;
+                name += rng() % 40 == 0 ? pick(unicode, rng) : pick(words, rng);
+            }
+            name += pick(suffixes, rng);
+            if (rng() % 8 == 0)
+                for (char & c : name) c = (char)::toupper((unsigned char)c);
+            out.strings.push_back(name);
+        }
+        finish(out);
+        return out;
+    }
+
+    // Creator names: camel-cased handles built from syllables, sometimes with digits or an x prefix
+    static corpus creator_names(int count, unsigned seed = 2) {
+        static const char * syllables[] = {
+            "vi", "prin", "ri", "ot", "cy", "clic", "ze", "ro", "np", "esta", "zo", "ink", "ser", "ponge", "knob", "bel",
+            "boy", "do", "rsha", "su", "nix", "tr", "usta", "sr", "gui", "lles", "ter", "mi", "chi", "gun", "ky", "ra"
+        };
+        corpus out{ "creator names", {}, {}, { "vp", "riot", "npesta", "sg", "xk", "gun", "qq" } };
+        std::mt19937 rng(seed);
+        for (int i = 0; i < count; ++i) {
+            std::string name = rng() % 10 == 0 ? "x" : "";
+            int syllableCount = 2 + (int)(rng() % 3);
+            for (int s = 0; s < syllableCount; ++s) {
+                std::string syllable = pick(syllables, rng);
+                if (s == 0 || rng() % 3 == 0)
+                    syllable[0] = (char)::toupper((unsigned char)syllable[0]);
+                name += syllable;
+            }
+            if (rng() % 4 == 0)
+                name += std::to_string(rng() % 1000);
+            out.strings.push_back(name);
+        }
+        finish(out);
+        return out;
+    }
+
+    // Level descriptions: 5 to 80 words, so a good share is past the 256 bytes that fit on the stack
+    static corpus descriptions(int count, unsigned seed = 3) {
+        static const char * words[] = {
+            "this", "level", "is", "my", "best", "work", "so", "far", "hope", "you", "enjoy", "it", "took", "months", "to",
+            "build", "thanks", "for", "playing", "verified", "by", "friend", "sync", "sonic", "wave", "deadlocked", "hard",
+            "demon", "insane", "easy", "collab", "with", "gameplay", "deco", "song", "ID", "in", "comments", "GG", "2.2"
+        };
+        corpus out{ "descriptions", {}, {}, { "sonic wave", "hard demon", "best level", "verified", "thx", "collab song id" } };
+        std::mt19937 rng(seed);
+        for (int i = 0; i < count; ++i) {
+            std::string description;
+            int wordCount = 5 + (int)(rng() % 76);
+            for (int w = 0; w < wordCount; ++w) {
+                if (w)
+                    description += rng() % 12 == 0 ? ", " : " ";
+                description += pick(words, rng);
+            }
+            out.strings.push_back(description);
+        }
+        finish(out);
+        return out;
+    }
+
+    // Repeated characters, where the old recursive search hit its recursion limit
+    static corpus pathological(int count, unsigned seed = 4) {
+        corpus out{ "pathological", {}, {}, { "aaaaaa", "abab", "aaaaaaaaaaaaaaaaaaaaaaaab", "ba" } };
+        std::mt19937 rng(seed);
+        for (int i = 0; i < count; ++i) {
+            int len = 16 + (int)(rng() % 300);
+            std::string str;
+            switch (i % 3) {
+                case 0: str.assign(len, 'a'); break;
+                case 1: for (int j = 0; j < len; ++j) str += "ab"[j % 2]; break;
+                default: str.assign(len, 'a'); str[rng() % len] = 'b'; break;
+            }
+            out.strings.push_back(str);
+        }
+        finish(out);
+        return out;
+    }
+}
+
+#endif // FTS_FUZZY_MATCH_CORPUS_H
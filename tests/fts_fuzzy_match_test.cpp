@@ -0,0 +1,470 @@
+// Regression suite for libraries/fts_fuzzy_match.h. Every search path must agree with plain fuzzy_match, fuzzy_match
+// must agree with an exhaustive search and with the old recursive matcher wherever that one was exhaustive, and the
+// golden scores pin the scoring model. After a deliberate scoring change, regenerate them with --golden > fts_fuzzy_match_golden.inc.
+
+#define FTS_FUZZY_MATCH_IMPLEMENTATION
+#include "fts_fuzzy_match.h"
+#include "fts_fuzzy_match_corpus.h"
+#include "fts_fuzzy_match_reference.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            ++failures; \
+            if (failures <= 20) \
+                printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+
+// Score of one particular set of match positions under the default profile, ASCII only
+static int score_positions(const std::string & str, const std::vector<int> & positions) {
+    int score = 100;
+    int penalty = fts::fuzzy_scoring::leading_letter_penalty * positions[0];
+    score += std::max(penalty, fts::fuzzy_scoring::max_leading_letter_penalty);
+    score += fts::fuzzy_scoring::unmatched_letter_penalty * ((int)str.size() - (int)positions.size());
+
+    for (size_t i = 0; i < positions.size(); ++i) {
+        int at = positions[i];
+        if (i > 0 && at == positions[i - 1] + 1)
+            score += fts::fuzzy_scoring::sequential_bonus;
+        if (at == 0) {
+            score += fts::fuzzy_scoring::first_letter_bonus;
+            continue;
+        }
+        char neighbor = str[at - 1];
+        if (::islower((unsigned char)neighbor) && ::isupper((unsigned char)str[at]))
+            score += fts::fuzzy_scoring::camel_bonus;
+        if (fts::fuzzy_scoring::is_separator(neighbor))
+            score += fts::fuzzy_scoring::separator_bonus;
+    }
+    return score;
+}
+
+// Best score over every way of matching pattern in str, or fts::fuzzy_internal::no_match
+static int exhaustive_score(const std::string & pattern, const std::string & str, size_t p, size_t s, std::vector<int> & positions) {
+    if (p == pattern.size())
+        return score_positions(str, positions);
+
+    int best = fts::fuzzy_internal::no_match;
+    for (size_t j = s; j < str.size(); ++j) {
+        if (::tolower((unsigned char)pattern[p]) != ::tolower((unsigned char)str[j]))
+            continue;
+        positions.push_back((int)j);
+        best = std::max(best, exhaustive_score(pattern, str, p + 1, j + 1, positions));
+        positions.pop_back();
+    }
+    return best;
+}
+
+static std::string random_string(std::mt19937 & rng, const char * alphabet, int maxLen) {
+    std::string str;
+    int len = (int)(rng() % (maxLen + 1));
+    size_t alphabetLen = strlen(alphabet);
+    for (int i = 0; i < len; ++i)
+        str += alphabet[rng() % alphabetLen];
+    return str;
+}
+
+static bool is_ascii(const std::string & str) {
+    return std::all_of(str.begin(), str.end(), [](char c) { return (unsigned char)c < 0x80; });
+}
+
+// The DP scorer finds the optimal score and reports positions that produce it
+static void test_exhaustive(int iterations) {
+    std::mt19937 rng(1);
+    for (int it = 0; it < iterations; ++it) {
+        std::string str = random_string(rng, "abAB_ c", 12);
+        std::string pattern = random_string(rng, "abAB", 4);
+        if (pattern.empty())
+            pattern = "a";
+
+        std::vector<int> scratch;
+        int expected = exhaustive_score(pattern, str, 0, 0, scratch);
+
+        int score = 0;
+        uint8_t matches[256];
+        bool matched = fts::fuzzy_match(pattern.c_str(), str.c_str(), score, matches, 256);
+        CHECK(matched == (expected != fts::fuzzy_internal::no_match));
+        if (!matched || expected == fts::fuzzy_internal::no_match)
+            continue;
+
+        CHECK(score == expected);
+        std::vector<int> positions(matches, matches + pattern.size());
+        for (size_t i = 0; i < positions.size(); ++i) {
+            CHECK(i == 0 || positions[i] > positions[i - 1]);
+            CHECK(::tolower((unsigned char)str[positions[i]]) == ::tolower((unsigned char)pattern[i]));
+        }
+        CHECK(score_positions(str, positions) == score);
+
+        int plainScore = 0;
+        CHECK(fts::fuzzy_match(pattern.c_str(), str.c_str(), plainScore) && plainScore == score);
+    }
+}
+
+// Same score as the 0.2.0 recursive matcher whenever its search stayed under the recursion limit, never lower otherwise
+static void test_recursive(int iterations) {
+    std::mt19937 rng(2);
+    int exhaustiveRuns = 0;
+    int improved = 0;
+
+    auto compare = [&](const char * pattern, const char * str) {
+        int recursionCount = 0;
+        int referenceScore = 0;
+        uint8_t referenceMatches[256];
+        bool referenceMatched = fts_reference::fuzzy_internal::fuzzy_match_recursive(pattern, str, referenceScore, str, nullptr,
+            referenceMatches, 256, 0, recursionCount, 10);
+
+        int score = 0;
+        bool matched = fts::fuzzy_match(pattern, str, score);
+        bool exhaustive = recursionCount < 10;
+        if (exhaustive) {
+            ++exhaustiveRuns;
+            CHECK(matched == referenceMatched);
+            CHECK(!matched || score == referenceScore);
+        }
+        else if (referenceMatched) {
+            CHECK(matched && score >= referenceScore);
+            improved += score > referenceScore;
+        }
+    };
+
+    for (int it = 0; it < iterations; ++it) {
+        std::string str = random_string(rng, "abcAB_ xyz", 40);
+        std::string pattern = random_string(rng, "abcxy", 5);
+        if (!pattern.empty())
+            compare(pattern.c_str(), str.c_str());
+    }
+
+    fts_corpus::corpus corpora[] = { fts_corpus::level_names(2000), fts_corpus::creator_names(2000) };
+    for (const fts_corpus::corpus & corpus : corpora) {
+        for (const char * pattern : corpus.patterns) {
+            for (const std::string & str : corpus.strings) {
+                if (is_ascii(pattern) && is_ascii(str) && str.size() < 256)
+                    compare(pattern, str.c_str());
+            }
+        }
+    }
+
+    CHECK(exhaustiveRuns > iterations / 2);
+    printf("  %d exhaustive comparisons, DP better in %d truncated ones\n", exhaustiveRuns, improved);
+}
+
+// Vectorized subsequence checks agree with the scalar loop and the old fuzzy_match_simple
+static void test_simple(int iterations) {
+    std::mt19937 rng(3);
+    fts::fuzzy_internal::fuzzy_pattern folded;
+
+    for (int it = 0; it < iterations; ++it) {
+        std::string str = random_string(rng, "abcABC_ xyz", 90);
+        std::string pattern = random_string(rng, "abcABC_ xyz", 5);
+        bool expected = fts_reference::fuzzy_match_simple(pattern.c_str(), str.c_str());
+        CHECK(fts::fuzzy_match_simple(pattern.c_str(), str.c_str()) == expected);
+
+        CHECK(fts::fuzzy_internal::fuzzy_pattern_init(folded, pattern.c_str()));
+        int len = (int)str.size();
+        CHECK(fts::fuzzy_internal::fuzzy_subsequence_scalar(folded, 0, str.c_str(), 0, len) == expected);
+#ifdef FTS_FUZZY_MATCH_SSE2
+        CHECK(fts::fuzzy_internal::fuzzy_subsequence_sse2(folded, 0, str.c_str(), 0, len) == expected);
+#endif
+#ifdef FTS_FUZZY_MATCH_AVX2
+        if (fts::fuzzy_internal::fuzzy_has_avx2())
+            CHECK(fts::fuzzy_internal::fuzzy_subsequence_avx2(folded, 0, str.c_str(), 0, len) == expected);
+#endif
+    }
+
+    fts_corpus::corpus corpus = fts_corpus::level_names(5000);
+    std::vector<int> survivors(corpus.pointers.size());
+    for (const char * pattern : corpus.patterns) {
+        int count = fts::fuzzy_filter(pattern, corpus.pointers.data(), (int)corpus.pointers.size(), survivors.data());
+        int expected = 0;
+        for (int i = 0; i < (int)corpus.pointers.size(); ++i) {
+            if (fts::fuzzy_match_simple(pattern, corpus.pointers[i]))
+                CHECK(expected < count && survivors[expected++] == i);
+        }
+        CHECK(count == expected);
+    }
+}
+
+// Scores under the default profile. A change here is a change in ranking that users will see.
+struct golden_case {
+    const char * pattern;
+    const char * str;
+    int score;  // fts::fuzzy_internal::no_match when it must not match
+};
+
+static const golden_case golden[] = {
+#include "fts_fuzzy_match_golden.inc"
+};
+
+static void test_golden(bool print) {
+    for (const golden_case & entry : golden) {
+        int score = fts::fuzzy_internal::no_match;
+        if (!fts::fuzzy_match(entry.pattern, entry.str, score))
+            score = fts::fuzzy_internal::no_match;
+
+        if (print) {
+            std::string str;
+            for (const char * c = entry.str; *c; ++c) {
+                if (*c == '"' || *c == '\\')
+                    str += '\\';
+                str += *c;
+            }
+            printf("    { \"%s\", \"%s\", %s },\n", entry.pattern, str.c_str(),
+                score == fts::fuzzy_internal::no_match ? "fts::fuzzy_internal::no_match" : std::to_string(score).c_str());
+            continue;
+        }
+
+        if (score != entry.score)
+            printf("  golden \"%s\" in \"%.40s\": expected %d, got %d\n", entry.pattern, entry.str, entry.score, score);
+        CHECK(score == entry.score);
+    }
+}
+
+static bool same_results(const fts::fuzzy_result * a, int aCount, const fts::fuzzy_result * b, int bCount) {
+    if (aCount != bCount)
+        return false;
+    for (int i = 0; i < aCount; ++i) {
+        if (a[i].index != b[i].index || a[i].score != b[i].score)
+            return false;
+    }
+    return true;
+}
+
+// Every search path returns the exhaustive top-k of fuzzy_match
+static void test_search_paths(const fts_corpus::corpus & corpus) {
+    const int k = 20;
+    const int count = (int)corpus.pointers.size();
+    const char * path = "fts_fuzzy_match_test.idx";
+
+    fts::fuzzy_index index;
+    fts::fuzzy_index_build(index, corpus.pointers.data(), count / 2);
+    remove(path);
+    CHECK(fts::fuzzy_index_append(path, index, 0));
+    for (int i = count / 2; i < count; ++i)
+        fts::fuzzy_index_add(index, corpus.pointers[i]);
+    CHECK(fts::fuzzy_index_append(path, index, count / 2));
+
+    fts::fuzzy_mapped_index mapped;
+    CHECK(fts::fuzzy_index_open(mapped, path));
+    CHECK(fts::fuzzy_index_size(mapped) == count);
+
+    fts::fuzzy_postings postings;
+    fts::fuzzy_postings_update(postings, index);
+
+    for (const char * pattern : corpus.patterns) {
+        std::vector<fts::fuzzy_result> all;
+        for (int i = 0; i < count; ++i) {
+            fts::fuzzy_result result = { i, 0 };
+            if (fts::fuzzy_match(pattern, corpus.pointers[i], result.score))
+                all.push_back(result);
+        }
+        std::sort(all.begin(), all.end(), [](const fts::fuzzy_result & a, const fts::fuzzy_result & b) {
+            return a.score != b.score ? a.score > b.score : a.index < b.index;
+        });
+        int expectedCount = std::min((int)all.size(), k);
+
+        fts::fuzzy_result results[k];
+        int resultCount = fts::fuzzy_search(pattern, corpus.pointers.data(), count, results, k);
+        CHECK(same_results(results, resultCount, all.data(), expectedCount));
+
+        fts::fuzzy_search_stats stats;
+        resultCount = fts::fuzzy_search(index, pattern, results, k, &stats);
+        CHECK(same_results(results, resultCount, all.data(), expectedCount));
+
+        resultCount = fts::fuzzy_search(index, postings, pattern, results, k);
+        CHECK(same_results(results, resultCount, all.data(), expectedCount));
+
+        for (int threads : { 2, 4 }) {
+            resultCount = fts::fuzzy_search_parallel(index, pattern, results, k, threads);
+            CHECK(same_results(results, resultCount, all.data(), expectedCount));
+        }
+
+        resultCount = fts::fuzzy_search(mapped, pattern, results, k);
+        CHECK(same_results(results, resultCount, all.data(), expectedCount));
+
+        // Typed one code point at a time
+        fts::fuzzy_session session;
+        fts::fuzzy_session_init(session, index);
+        std::string typed;
+        for (const char * c = pattern; *c; ) {
+            do { typed += *c++; } while ((*c & 0xC0) == 0x80);
+            resultCount = fts::fuzzy_session_update(session, typed.c_str(), results, k);
+        }
+        CHECK(same_results(results, resultCount, all.data(), expectedCount));
+
+        for (int i = 0; i < expectedCount; ++i) {
+            int score = 0;
+            CHECK(fts::fuzzy_match(index, all[i].index, pattern, score) && score == all[i].score);
+            CHECK(fts::fuzzy_match(mapped, all[i].index, pattern, score) && score == all[i].score);
+        }
+    }
+
+    fts::fuzzy_index_close(mapped);
+    remove(path);
+}
+
+// Terms sum their individual scores; ranges cover exactly the matched code points
+static void test_terms_and_ranges(const fts_corpus::corpus & corpus) {
+    for (const char * pattern : corpus.patterns) {
+        std::vector<std::string> terms;
+        for (const char * c = pattern; *c; ) {
+            const char * end = strchr(c, ' ');
+            if (!end)
+                end = c + strlen(c);
+            if (end > c)
+                terms.emplace_back(c, end);
+            c = *end ? end + 1 : end;
+        }
+
+        for (const std::string & str : corpus.strings) {
+            int expected = 0;
+            bool all = true;
+            for (const std::string & term : terms) {
+                int score = 0;
+                all = all && fts::fuzzy_match(term.c_str(), str.c_str(), score);
+                expected += score;
+            }
+
+            int score = 0;
+            bool matched = fts::fuzzy_match_terms(pattern, str.c_str(), score);
+            CHECK(matched == all);
+            CHECK(!matched || score == expected);
+
+            int positions[256];
+            int plainScore = 0;
+            fts::fuzzy_range ranges[256];
+            int rangeCount = 0;
+            bool plain = fts::fuzzy_match(pattern, str.c_str(), plainScore, positions, 256);
+            CHECK(fts::fuzzy_match_ranges(pattern, str.c_str(), score, ranges, 256, rangeCount) == plain);
+            if (!plain)
+                continue;
+
+            CHECK(score == plainScore);
+            int next = 0;
+            for (int r = 0; r < rangeCount; ++r) {
+                CHECK(ranges[r].begin < ranges[r].end && (r == 0 || ranges[r].begin > ranges[r - 1].end));
+                for (int at = ranges[r].begin; at < ranges[r].end; ++at) {
+                    bool lead = ((unsigned char)str[at] & 0xC0) != 0x80;
+                    if (lead)
+                        CHECK(next < 256 && positions[next++] == at);
+                }
+            }
+            CHECK(std::string(pattern).find(' ') != std::string::npos || next > 0);
+        }
+    }
+}
+
+static void test_utf8() {
+    int score = 0;
+    CHECK(fts::fuzzy_match("élan", "ÉLAN XL", score));
+    CHECK(fts::fuzzy_match("жизнь", "ЖИЗНЬ", score));
+    CHECK(fts::fuzzy_match("full", "Ｆｕｌｌ", score) == false);
+    CHECK(fts::fuzzy_match("ｆｕｌｌ", "ＦＵＬＬ", score));
+    CHECK(fts::fuzzy_match("ωmega", "ΩMEGA", score));
+    CHECK(fts::fuzzy_match("\xff", "a\xff", score));
+    CHECK(fts::fuzzy_match("\xff", "a\xfe", score) == false);
+    CHECK(fts::fuzzy_match("e", "É", score) == false);
+}
+
+// Fixed bugs that must stay fixed
+static void test_regressions() {
+    // Candidates added after a session started show up in later updates
+    {
+        fts::fuzzy_index index;
+        const char * strs[] = { "apple", "banana" };
+        fts::fuzzy_index_build(index, strs, 2);
+        fts::fuzzy_session session;
+        fts::fuzzy_session_init(session, index);
+        fts::fuzzy_result results[4];
+        fts::fuzzy_session_update(session, "gr", results, 4);
+        fts::fuzzy_index_add(index, "grape");
+        CHECK(fts::fuzzy_session_update(session, "gra", results, 4) == 1);
+    }
+
+    // A match past byte 255 is still reported through a uint8_t buffer
+    {
+        std::string str = std::string(300, 'x') + "abc";
+        uint8_t narrow[4];
+        uint16_t wide[4];
+        int narrowScore = 0, wideScore = 0, fit = -1;
+        CHECK(fts::fuzzy_match("abc", str.c_str(), narrowScore, narrow, 4, &fit));
+        CHECK(fts::fuzzy_match("abc", str.c_str(), wideScore, wide, 4));
+        CHECK(narrowScore == wideScore && fit == 0 && narrow[0] == 255 && wide[0] == 300);
+    }
+
+    // Index files reject duplicate appends and corrupt offsets
+    {
+        const char * path = "fts_fuzzy_match_regression.idx";
+        remove(path);
+        fts::fuzzy_index index;
+        const char * strs[] = { "apple", "banana" };
+        fts::fuzzy_index_build(index, strs, 2);
+        fts::fuzzy_index empty;
+        CHECK(fts::fuzzy_index_append(path, empty, 0));
+        CHECK(fts::fuzzy_index_append(path, empty, 0));
+        CHECK(fts::fuzzy_index_append(path, index, 0));
+        CHECK(!fts::fuzzy_index_append(path, index, 0));
+
+        fts::fuzzy_mapped_index mapped;
+        CHECK(fts::fuzzy_index_open(mapped, path) && fts::fuzzy_index_size(mapped) == 2);
+        fts::fuzzy_index_close(mapped);
+
+        // offsets[1] of the first segment: file header, segment header, offsets[0]
+        FILE * file = fopen(path, "r+b");
+        uint32_t corrupt = 1000000;
+        CHECK(file && fseek(file, 16 + 8 + 4, SEEK_SET) == 0 && fwrite(&corrupt, sizeof(corrupt), 1, file) == 1);
+        if (file)
+            fclose(file);
+        CHECK(!fts::fuzzy_index_open(mapped, path));
+        remove(path);
+    }
+}
+
+int main(int argc, char ** argv) {
+    if (argc > 1 && strcmp(argv[1], "--golden") == 0) {
+        test_golden(true);
+        return 0;
+    }
+
+    struct {
+        const char * name;
+        void (*run)();
+    } tests[] = {
+        { "exhaustive", [] { test_exhaustive(50000); } },
+        { "recursive reference", [] { test_recursive(50000); } },
+        { "simple and filter", [] { test_simple(100000); } },
+        { "golden scores", [] { test_golden(false); } },
+        { "search paths", [] {
+            test_search_paths(fts_corpus::level_names(20000));
+            test_search_paths(fts_corpus::creator_names(20000));
+            test_search_paths(fts_corpus::descriptions(3000));
+            test_search_paths(fts_corpus::pathological(600));
+        } },
+        { "terms and ranges", [] {
+            test_terms_and_ranges(fts_corpus::level_names(3000));
+            test_terms_and_ranges(fts_corpus::descriptions(500));
+        } },
+        { "utf-8", test_utf8 },
+        { "regressions", test_regressions },
+    };
+
+    for (const auto & test : tests) {
+        int before = failures;
+        printf("%s\n", test.name);
+        test.run();
+        if (failures != before)
+            printf("  %d failures\n", failures - before);
+    }
+
+    printf(failures ? "FAILED (%d)\n" : "OK\n", failures);
+    return failures ? 1 : 0;
+}